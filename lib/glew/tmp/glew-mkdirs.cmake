@@ -0,0 +1,22 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file Copyright.txt or https://cmake.org/licensing for details.
+
+cmake_minimum_required(VERSION 3.5)
+
+file(MAKE_DIRECTORY
+  "/root/repo/lib/glew/src/glew"
+  "/root/repo/lib/glew/src/glew-build"
+  "/root/repo/lib/glew"
+  "/root/repo/lib/glew/tmp"
+  "/root/repo/lib/glew/src/glew-stamp"
+  "/root/repo/lib/glew/src"
+  "/root/repo/lib/glew/src/glew-stamp"
+)
+
+set(configSubDirs )
+foreach(subDir IN LISTS configSubDirs)
+    file(MAKE_DIRECTORY "/root/repo/lib/glew/src/glew-stamp/${subDir}")
+endforeach()
+if(cfgdir)
+  file(MAKE_DIRECTORY "/root/repo/lib/glew/src/glew-stamp${cfgdir}") # cfgdir has leading slash
+endif()
@@ -0,0 +1,22 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file Copyright.txt or https://cmake.org/licensing for details.
+
+cmake_minimum_required(VERSION 3.5)
+
+file(MAKE_DIRECTORY
+  "/root/repo/lib/glfw/src/glfw"
+  "/root/repo/lib/glfw/src/glfw-build"
+  "/root/repo/lib/glfw/install"
+  "/root/repo/lib/glfw/tmp"
+  "/root/repo/lib/glfw/src/glfw-stamp"
+  "/root/repo/lib/glfw/src"
+  "/root/repo/lib/glfw/src/glfw-stamp"
+)
+
+set(configSubDirs )
+foreach(subDir IN LISTS configSubDirs)
+    file(MAKE_DIRECTORY "/root/repo/lib/glfw/src/glfw-stamp/${subDir}")
+endforeach()
+if(cfgdir)
+  file(MAKE_DIRECTORY "/root/repo/lib/glfw/src/glfw-stamp${cfgdir}") # cfgdir has leading slash
+endif()
@@ -0,0 +1,388 @@
+// Scene benchmark: runs every demo scene headless with a fixed seed and step,
+// sweeping particle caps and thread counts, and writes how fast each
+// combination steps its particles as JSON. Every run of a combination
+// simulates exactly the same particles, whatever the thread count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+	#include <sys/resource.h>
+#endif
+
+#include "particle_system.hpp"
+#include "profiler.hpp"
+#include "runner.hpp"
+#include "scene.hpp"
+
+using namespace std;
+
+#define BENCHBASECAP 10000		// cap the scenes are run at their own spawn rates for
+#define BENCHFILL 0.95			// fraction of the cap warming up stops at
+
+typedef struct {
+	vector<string> scenes;
+	vector<long long> caps;
+	vector<int> threads;
+	long frames;		// steps timed per run
+	long warmup;		// most steps taken to fill up to the cap before timing
+	double dt;			// seconds per step
+	unsigned long long seed;
+	int chunkSize;
+	int repeat;			// runs per combination
+	string outPath;
+} BenchOptions;
+
+// What one run of a combination measured
+typedef struct {
+	double nsPerParticleStep;
+	double spawnsPerSecond;
+	double particles;			// live particles, averaged over the timed steps
+	long long peakParticleBytes;	// most bytes the particle arrays took
+	long long peakRssBytes;		// most memory the process had resident, 0 where unknown
+	double phases[NUMPHASES];	// milliseconds per step, -1 for phases that didn't run
+} BenchRun;
+
+//----------------------------------------------------------------------------
+// functions for measuring the process's peak memory. Linux lets the peak be
+// reset before every run; macOS only has the peak of the whole process.
+
+static void resetPeakMemory() {
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file) {
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+static long long peakMemory() {
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/status", "r");
+	if (!file)
+		return 0;
+	char line[256];
+	long long kilobytes = 0;
+	while (fgets(line, sizeof(line), file))
+		if (sscanf(line, "VmHWM: %lld kB", &kilobytes) == 1)
+			break;
+	fclose(file);
+	return kilobytes*1024;
+#elif defined(__APPLE__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#else
+	return 0;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// functions for reading the command line
+
+static void printUsage(const char *program) {
+	cerr << "usage: " << program << " [--scenes a,b] [--caps n,n] [--threads n,n] [--frames n] [--warmup n] [--dt seconds] [--seed n] [--chunk n] [--repeat n] [--out file]" << endl;
+	cerr << "  --scenes    scenes to run (default fire,water_fountain,bouncing_ball,fireworks,art)" << endl;
+	cerr << "  --caps      particle caps to sweep (default 10000,100000,1000000,10000000); spawn rates are" << endl;
+	cerr << "              scaled by cap/" << BENCHBASECAP << " so the scenes fill them" << endl;
+	cerr << "  --threads   thread counts to sweep (default powers of two up to the hardware threads)" << endl;
+	cerr << "  --frames    steps timed per run (default 240)" << endl;
+	cerr << "  --warmup    most steps taken to fill up to the cap before timing (default 1200)" << endl;
+	cerr << "  --dt        seconds per step, as a number or a fraction (default 1/120, the viewer's step)" << endl;
+	cerr << "  --repeat    runs of every combination (default 5)" << endl;
+	cerr << "  --out       file to write the results to (default particle_bench.json)" << endl;
+}
+
+// Splits a comma-separated list
+static vector<string> splitList(const char *text) {
+	vector<string> items;
+	string item;
+	for (const char *c = text; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				break;
+		}
+		else
+			item += *c;
+	}
+	return items;
+}
+
+template<typename T>
+static bool parseNumbers(const char *text, vector<T> &numbers) {
+	vector<string> items = splitList(text);
+	numbers.clear();
+	for (size_t i = 0; i < items.size(); i++) {
+		char *end;
+		long long number = strtoll(items[i].c_str(), &end, 10);
+		if (*end != '\0' || number <= 0)
+			return false;
+		numbers.push_back((T)number);
+	}
+	return !numbers.empty();
+}
+
+static bool parseBenchOptions(int argc, char** argv, BenchOptions &options) {
+	options.scenes = splitList("fire,water_fountain,bouncing_ball,fireworks,art");
+	options.caps.clear();
+	for (long long cap = BENCHBASECAP; cap <= 10000000; cap *= 10)
+		options.caps.push_back(cap);
+	int hardwareThreads = max(1, (int)std::thread::hardware_concurrency());
+	options.threads.clear();
+	for (int threads = 1; threads < hardwareThreads; threads *= 2)
+		options.threads.push_back(threads);
+	options.threads.push_back(hardwareThreads);
+	options.frames = 240;
+	options.warmup = 1200;
+	options.dt = 1.0/120.0;
+	options.seed = RANDOMSEED;
+	options.chunkSize = DEFAULTCHUNKSIZE;
+	options.repeat = 5;
+	options.outPath = "particle_bench.json";
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+			printUsage(argv[0]);
+			return false;
+		}
+
+		// Everything else takes a value
+		bool ok = value != NULL;
+		if (ok && strcmp(arg, "--scenes") == 0) {
+			options.scenes = splitList(value);
+			ok = !options.scenes.empty();
+		}
+		else if (ok && strcmp(arg, "--caps") == 0) {
+			ok = parseNumbers(value, options.caps);
+		}
+		else if (ok && strcmp(arg, "--threads") == 0) {
+			ok = parseNumbers(value, options.threads);
+		}
+		else if (ok && strcmp(arg, "--frames") == 0) {
+			char *end;
+			options.frames = strtol(value, &end, 10);
+			ok = *end == '\0' && options.frames > 0;
+		}
+		else if (ok && strcmp(arg, "--warmup") == 0) {
+			char *end;
+			options.warmup = strtol(value, &end, 10);
+			ok = *end == '\0' && *value != '\0' && options.warmup >= 0;
+		}
+		else if (ok && strcmp(arg, "--dt") == 0) {
+			ok = parseSeconds(value, options.dt);
+		}
+		else if (ok && strcmp(arg, "--seed") == 0) {
+			char *end;
+			options.seed = strtoull(value, &end, 0);
+			ok = *end == '\0' && *value != '\0';
+		}
+		else if (ok && strcmp(arg, "--chunk") == 0) {
+			char *end;
+			options.chunkSize = strtol(value, &end, 10);
+			ok = *end == '\0' && options.chunkSize > 0;
+		}
+		else if (ok && strcmp(arg, "--repeat") == 0) {
+			char *end;
+			options.repeat = strtol(value, &end, 10);
+			ok = *end == '\0' && options.repeat > 0;
+		}
+		else if (ok && strcmp(arg, "--out") == 0) {
+			options.outPath = value;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			cerr << "bad argument: " << arg << (value ? string(" ") + value : string()) << endl;
+			printUsage(argv[0]);
+			return false;
+		}
+		i++;
+	}
+
+	for (size_t i = 0; i < options.scenes.size(); i++) {
+		Scene *scene = createScene(options.scenes[i]);
+		if (!scene) {
+			cerr << "unknown scene: " << options.scenes[i] << endl;
+			return false;
+		}
+		delete scene;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+// Runs a scene under a cap on some threads: steps it until it fills the cap
+// (or the warmup runs out), then times options.frames steps
+static BenchRun runScene(const BenchOptions &options, const string &sceneName, long long cap, int threads) {
+	resetPeakMemory();
+
+	// Seed before creating the scene, which draws random numbers as it sets up
+	ParticleSystem *system = new ParticleSystem(cap);
+	system->setThreads(threads, options.chunkSize);
+	system->setSeed(options.seed);
+	system->setSpawnScale(max(1.0, (double)cap/BENCHBASECAP));
+	system->setQuiet(true);
+	Scene *scene = createScene(sceneName);
+	scene->init(*system);
+
+	long long peakBytes = system->bytes();
+	for (long step = 0; step < options.warmup && system->numParticles < BENCHFILL*cap; step++) {
+		scene->spawn(*system, options.dt);
+		system->update(options.dt);
+		peakBytes = max(peakBytes, system->bytes());
+	}
+
+	Profiler profiler;
+	system->setProfiler(&profiler);
+	long long spawned = system->numSpawned;
+	long long updated = system->numUpdated;
+	double particles = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long frame = 0; frame < options.frames; frame++) {
+		ProfileTimer timer(&profiler, PHASE_FRAME, system->frame, system->numParticles);
+		scene->spawn(*system, options.dt);
+		system->update(options.dt);
+		timer.stop();
+		profiler.collect();
+		particles += system->numParticles;
+		peakBytes = max(peakBytes, system->bytes());
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	system->setProfiler(NULL);
+	profiler.finish();
+
+	double seconds = max(std::chrono::duration<double>(end - start).count(), 1e-9);
+	updated = system->numUpdated - updated;
+	spawned = system->numSpawned - spawned;
+
+	BenchRun run;
+	run.nsPerParticleStep = updated > 0 ? 1e9*seconds/updated : 0.0;
+	run.spawnsPerSecond = spawned/seconds;
+	run.particles = particles/options.frames;
+	run.peakParticleBytes = peakBytes;
+	run.peakRssBytes = peakMemory();
+	for (int phase = 0; phase < NUMPHASES; phase++) {
+		const vector<float> &totals = profiler.frames(phase);
+		double total = 0.0;
+		for (size_t i = 0; i < totals.size(); i++)
+			total += totals[i];
+		run.phases[phase] = totals.empty() ? -1.0 : total/options.frames;
+	}
+
+	delete system;
+	delete scene;
+	return run;
+}
+
+static double median(vector<double> values) {
+	sort(values.begin(), values.end());
+	size_t middle = values.size()/2;
+	return values.size() % 2 ? values[middle] : 0.5*(values[middle - 1] + values[middle]);
+}
+
+static void writeRun(ostream &out, const BenchRun &run) {
+	out << "{\"nsPerParticleStep\": " << run.nsPerParticleStep << ", \"spawnsPerSec\": " << run.spawnsPerSecond
+		<< ", \"particles\": " << run.particles << ", \"peakParticleBytes\": " << run.peakParticleBytes
+		<< ", \"peakRssBytes\": " << run.peakRssBytes << ", \"phases\": {";
+	bool first = true;
+	for (int phase = 0; phase < NUMPHASES; phase++) {
+		if (run.phases[phase] < 0.0)
+			continue;
+		out << (first ? "" : ", ") << "\"" << Profiler::phaseName(phase) << "\": " << run.phases[phase];
+		first = false;
+	}
+	out << "}}";
+}
+
+//----------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, options))
+		return EXIT_FAILURE;
+
+	ofstream out(options.outPath.c_str());
+	if (!out) {
+		cerr << "couldn't write " << options.outPath << endl;
+		return EXIT_FAILURE;
+	}
+
+	out << "{" << endl;
+	out << "  \"benchmark\": \"particle_bench\"," << endl;
+	out << "  \"seed\": " << options.seed << ", \"dt\": " << options.dt << ", \"frames\": " << options.frames
+		<< ", \"warmup\": " << options.warmup << ", \"repeat\": " << options.repeat << ", \"chunk\": " << options.chunkSize
+		<< ", \"hardwareThreads\": " << std::thread::hardware_concurrency() << "," << endl;
+	out << "  \"results\": [";
+
+	bool firstResult = true;
+	for (size_t s = 0; s < options.scenes.size(); s++) {
+		for (size_t c = 0; c < options.caps.size(); c++) {
+			for (size_t t = 0; t < options.threads.size(); t++) {
+				const string &scene = options.scenes[s];
+				long long cap = options.caps[c];
+				int threads = options.threads[t];
+
+				vector<BenchRun> runs;
+				vector<double> nsPerParticleStep, spawnsPerSecond, particles;
+				long long peakParticleBytes = 0, peakRssBytes = 0;
+				for (int r = 0; r < options.repeat; r++) {
+					runs.push_back(runScene(options, scene, cap, threads));
+					nsPerParticleStep.push_back(runs.back().nsPerParticleStep);
+					spawnsPerSecond.push_back(runs.back().spawnsPerSecond);
+					particles.push_back(runs.back().particles);
+					peakParticleBytes = max(peakParticleBytes, runs.back().peakParticleBytes);
+					peakRssBytes = max(peakRssBytes, runs.back().peakRssBytes);
+				}
+
+				cout << scene << ", cap " << cap << ", " << threads << " threads: " << median(nsPerParticleStep)
+					 << " ns/particle/step, " << median(spawnsPerSecond) << " spawns/sec, "
+					 << median(particles) << " particles, " << peakRssBytes/(1024*1024) << " MiB peak" << endl;
+
+				out << (firstResult ? "" : ",") << endl;
+				firstResult = false;
+				out << "    {\"scene\": \"" << scene << "\", \"cap\": " << cap << ", \"threads\": " << threads
+					<< ", \"spawnScale\": " << max(1.0, (double)cap/BENCHBASECAP)
+					<< ", \"particles\": " << median(particles)
+					<< ", \"nsPerParticleStep\": " << median(nsPerParticleStep)
+					<< ", \"spawnsPerSec\": " << median(spawnsPerSecond)
+					<< ", \"peakParticleBytes\": " << peakParticleBytes
+					<< ", \"peakRssBytes\": " << peakRssBytes << "," << endl;
+				out << "     \"runs\": [";
+				for (size_t r = 0; r < runs.size(); r++) {
+					out << (r > 0 ? ",\n              " : "");
+					writeRun(out, runs[r]);
+				}
+				out << "]}";
+			}
+		}
+	}
+	out << endl << "  ]" << endl << "}" << endl;
+
+	if (!out) {
+		cerr << "couldn't write " << options.outPath << endl;
+		return EXIT_FAILURE;
+	}
+	cout << "Wrote " << options.outPath << endl;
+	return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,498 @@
+// Compares benchmark result files, written by particle_bench or math_bench,
+// and flags the changes that are larger than the noise. Every benchmark (a
+// scene at a cap and thread count, or a math primitive) and every phase of a
+// scene is compared on the median of its runs, and a Mann-Whitney U test on
+// the runs decides whether the difference is real. The test takes the runs
+// to be independent, so a math_bench file counts as a single run (the median
+// of its samples, which one process takes back to back) and each side can be
+// given several files. The p-values are Holm-corrected over all the tests, so
+// hundreds of phases don't turn up regressions by chance. Exits with 1 if
+// anything got significantly slower.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define COMPAREALPHA 0.05		// Holm-corrected p-value under which a difference counts
+#define COMPARETHRESHOLD 5.0	// percent slower a benchmark must get to count as a regression
+#define COMPAREMINMS 0.01		// phases taking less than this many ms per step are too small to judge
+#define EXACTSAMPLES 20			// largest sample size the exact U distribution is worked out for
+
+//----------------------------------------------------------------------------
+// Just enough JSON for the benchmark files: objects, arrays, strings, numbers,
+// true, false and null
+
+typedef struct JsonValue {
+	enum { NONE, NUMBER, STRING, ARRAY, OBJECT } type;
+	double number;
+	string text;
+	vector<JsonValue> items;
+	vector< pair<string, JsonValue> > members;
+
+	JsonValue() : type(NONE), number(0) {}
+
+	// The member with a name, or a value of type NONE
+	const JsonValue &operator[](const string &name) const {
+		static const JsonValue none;
+		for (size_t i = 0; i < members.size(); i++)
+			if (members[i].first == name)
+				return members[i].second;
+		return none;
+	}
+} JsonValue;
+
+class JsonParser {
+public:
+	JsonParser(const string &text) : text(text), at(0) {}
+
+	bool parse(JsonValue &value) {
+		if (!parseValue(value))
+			return false;
+		skipSpace();
+		return at == text.size();
+	}
+
+private:
+	const string &text;
+	size_t at;
+
+	void skipSpace() {
+		while (at < text.size() && isspace((unsigned char)text[at]))
+			at++;
+	}
+
+	bool take(char c) {
+		skipSpace();
+		if (at < text.size() && text[at] == c) {
+			at++;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseString(string &out) {
+		if (!take('"'))
+			return false;
+		out.clear();
+		while (at < text.size() && text[at] != '"') {
+			if (text[at] == '\\' && at + 1 < text.size())
+				at++;
+			out += text[at++];
+		}
+		return take('"');
+	}
+
+	bool parseValue(JsonValue &value) {
+		skipSpace();
+		if (at >= text.size())
+			return false;
+
+		char c = text[at];
+		if (c == '{') {
+			at++;
+			value.type = JsonValue::OBJECT;
+			if (take('}'))
+				return true;
+			do {
+				pair<string, JsonValue> member;
+				if (!parseString(member.first) || !take(':') || !parseValue(member.second))
+					return false;
+				value.members.push_back(member);
+			} while (take(','));
+			return take('}');
+		}
+		if (c == '[') {
+			at++;
+			value.type = JsonValue::ARRAY;
+			if (take(']'))
+				return true;
+			do {
+				value.items.push_back(JsonValue());
+				if (!parseValue(value.items.back()))
+					return false;
+			} while (take(','));
+			return take(']');
+		}
+		if (c == '"') {
+			value.type = JsonValue::STRING;
+			return parseString(value.text);
+		}
+		if (text.compare(at, 4, "true") == 0 || text.compare(at, 4, "null") == 0) {
+			at += 4;
+			return true;
+		}
+		if (text.compare(at, 5, "false") == 0) {
+			at += 5;
+			return true;
+		}
+
+		const char *start = text.c_str() + at;
+		char *end;
+		value.type = JsonValue::NUMBER;
+		value.number = strtod(start, &end);
+		at += end - start;
+		return end != start;
+	}
+};
+
+//----------------------------------------------------------------------------
+// The benchmarks of one side, each with the runs of its main figure (ns per
+// particle per step, or ns per element) and of every phase (ms per step).
+// particle_bench runs are pooled over the side's files; a math_bench file
+// adds one run per primitive.
+
+typedef struct {
+	vector<double> runs;
+	map< string, vector<double> > phases;
+} Benchmark;
+
+typedef map<string, Benchmark> BenchmarkFile;
+
+static double median(vector<double> values) {
+	if (values.empty())
+		return 0.0;
+	sort(values.begin(), values.end());
+	size_t middle = values.size()/2;
+	return values.size() % 2 ? values[middle] : 0.5*(values[middle - 1] + values[middle]);
+}
+
+// Adds a file's runs to its side's. kind is the benchmark the side's files
+// come from, empty until the first one is read.
+static bool loadBenchmarks(const string &path, BenchmarkFile &benchmarks, string &kind) {
+	ifstream in(path.c_str());
+	if (!in) {
+		cerr << "couldn't read " << path << endl;
+		return false;
+	}
+	stringstream buffer;
+	buffer << in.rdbuf();
+	string text = buffer.str();
+
+	JsonValue root;
+	JsonParser parser(text);
+	if (!parser.parse(root) || root.type != JsonValue::OBJECT) {
+		cerr << "couldn't parse " << path << endl;
+		return false;
+	}
+
+	string fileKind = root["benchmark"].text;
+	if (fileKind != "particle_bench" && fileKind != "math_bench") {
+		cerr << path << " isn't from particle_bench or math_bench" << endl;
+		return false;
+	}
+	if (!kind.empty() && fileKind != kind) {
+		cerr << path << " is from " << fileKind << " but the files before it are from " << kind << endl;
+		return false;
+	}
+	kind = fileKind;
+
+	const JsonValue &results = root["results"];
+	for (size_t r = 0; r < results.items.size(); r++) {
+		const JsonValue &result = results.items[r];
+		const JsonValue &runs = result["runs"];
+
+		if (kind == "particle_bench") {
+			stringstream key;
+			key << result["scene"].text << ", cap " << (long long)result["cap"].number << ", " << (int)result["threads"].number << " threads";
+			Benchmark &benchmark = benchmarks[key.str()];
+			for (size_t i = 0; i < runs.items.size(); i++) {
+				benchmark.runs.push_back(runs.items[i]["nsPerParticleStep"].number);
+				const JsonValue &phases = runs.items[i]["phases"];
+				for (size_t p = 0; p < phases.members.size(); p++)
+					benchmark.phases[phases.members[p].first].push_back(phases.members[p].second.number);
+			}
+		}
+		else {
+			vector<double> samples;
+			for (size_t i = 0; i < runs.items.size(); i++)
+				samples.push_back(runs.items[i].number);
+			benchmarks[result["name"].text].runs.push_back(median(samples));
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// functions for the statistics
+
+// Two-sided p-value of the Mann-Whitney U test that a and b come from the same
+// distribution. Small samples without ties get the exact distribution of U,
+// the rest the normal approximation with a tie correction.
+static double mannWhitney(const vector<double> &a, const vector<double> &b) {
+	int n1 = (int)a.size(), n2 = (int)b.size(), n = n1 + n2;
+	if (n1 == 0 || n2 == 0)
+		return 1.0;
+
+	// Rank everything together, giving ties the average of their ranks
+	vector< pair<double, int> > all;
+	for (int i = 0; i < n1; i++)
+		all.push_back(make_pair(a[i], 0));
+	for (int i = 0; i < n2; i++)
+		all.push_back(make_pair(b[i], 1));
+	sort(all.begin(), all.end());
+
+	double rankSumA = 0.0, tieTerm = 0.0;
+	for (int i = 0; i < n; ) {
+		int j = i;
+		while (j < n && all[j].first == all[i].first)
+			j++;
+		double rank = 0.5*(i + 1 + j);
+		for (int k = i; k < j; k++)
+			if (all[k].second == 0)
+				rankSumA += rank;
+		double t = j - i;
+		tieTerm += t*t*t - t;
+		i = j;
+	}
+	double u = rankSumA - 0.5*n1*(n1 + 1);
+
+	if (tieTerm == 0.0 && n1 <= EXACTSAMPLES && n2 <= EXACTSAMPLES) {
+		// counts[i][j][k]: orderings of i values of a and j of b with U = k,
+		// built up by adding the largest value last
+		int maxU = n1*n2;
+		vector< vector< vector<double> > > counts(n1 + 1, vector< vector<double> >(n2 + 1, vector<double>(maxU + 1, 0.0)));
+		for (int i = 0; i <= n1; i++)
+			for (int j = 0; j <= n2; j++) {
+				if (i == 0 || j == 0) {
+					counts[i][j][0] = 1.0;
+					continue;
+				}
+				for (int k = 0; k <= i*j; k++)
+					counts[i][j][k] = (k >= j ? counts[i - 1][j][k - j] : 0.0) + counts[i][j - 1][k];
+			}
+
+		double total = 0.0, below = 0.0, above = 0.0;
+		for (int k = 0; k <= maxU; k++) {
+			total += counts[n1][n2][k];
+			if (k <= u)
+				below += counts[n1][n2][k];
+			if (k >= u)
+				above += counts[n1][n2][k];
+		}
+		return min(1.0, 2.0*min(below, above)/total);
+	}
+
+	double mean = 0.5*n1*n2;
+	double variance = n1*n2/12.0*((n + 1) - tieTerm/((double)n*(n - 1)));
+	if (variance <= 0.0)
+		return 1.0;
+	double z = max(0.0, fabs(u - mean) - 0.5)/sqrt(variance);
+	return erfc(z/sqrt(2.0));
+}
+
+// Smallest p-value the test can give n1 runs against n2: the exact one for
+// every run of one side below every run of the other
+static double smallestP(int n1, int n2) {
+	double orderings = 1.0;
+	for (int k = 1; k <= n2; k++)
+		orderings *= (double)(n1 + k)/k;
+	return min(1.0, 2.0/orderings);
+}
+
+//----------------------------------------------------------------------------
+
+typedef struct {
+	double alpha;
+	double threshold;	// percent
+	double minMs;
+} CompareOptions;
+
+typedef struct {
+	string name;
+	double before, after;	// medians
+	double delta;			// percent
+	double p;
+	double adjusted;		// p after the Holm correction
+	bool judge;				// whether it is tested at all
+	int n1, n2;				// runs a side
+} Comparison;
+
+static void compareRuns(const string &name, const vector<double> &base, const vector<double> &runs,
+						bool judge, vector<Comparison> &comparisons) {
+	Comparison comparison;
+	comparison.name = name;
+	comparison.before = median(base);
+	comparison.after = median(runs);
+	comparison.delta = comparison.before > 0.0 ? 100.0*(comparison.after - comparison.before)/comparison.before : 0.0;
+	comparison.p = mannWhitney(base, runs);
+	comparison.adjusted = 1.0;
+	comparison.judge = judge;
+	comparison.n1 = (int)base.size();
+	comparison.n2 = (int)runs.size();
+	comparisons.push_back(comparison);
+}
+
+// Holm-Bonferroni: the k-th smallest of m p-values is scaled by m - k + 1,
+// and an adjusted p-value is never below the one before it, which keeps the
+// chance of any false regression over all m tests under alpha
+static int adjustHolm(vector<Comparison> &comparisons) {
+	vector< pair<double, size_t> > order;
+	for (size_t i = 0; i < comparisons.size(); i++)
+		if (comparisons[i].judge)
+			order.push_back(make_pair(comparisons[i].p, i));
+	sort(order.begin(), order.end());
+
+	int m = (int)order.size();
+	double previous = 0.0;
+	for (int k = 0; k < m; k++) {
+		previous = max(previous, min(1.0, (m - k)*order[k].first));
+		comparisons[order[k].second].adjusted = previous;
+	}
+	return m;
+}
+
+// Prints one comparison and returns whether it is a significant regression
+static bool printComparison(const Comparison &comparison, const CompareOptions &options) {
+	const char *verdict = "";
+	bool regression = false;
+	if (comparison.judge && comparison.adjusted < options.alpha && fabs(comparison.delta) >= options.threshold) {
+		regression = comparison.delta > 0.0;
+		verdict = regression ? "SLOWER" : "faster";
+	}
+
+	char adjusted[16] = "-";
+	if (comparison.judge)
+		snprintf(adjusted, sizeof(adjusted), "%.4f", comparison.adjusted);
+
+	char line[220];
+	snprintf(line, sizeof(line), "%-40s %12.4f %12.4f %+8.1f%% %8.4f %8s  %s", comparison.name.c_str(),
+			 comparison.before, comparison.after, comparison.delta, comparison.p, adjusted, verdict);
+	cout << line << endl;
+	return regression;
+}
+
+static void printUsage(const char *program) {
+	cerr << "usage: " << program << " baseline.json new.json [--alpha p] [--threshold percent] [--min-ms ms]" << endl;
+	cerr << "       " << program << " baseline.json... -- new.json... [options]" << endl;
+	cerr << "  --alpha      chance of any false regression over all the tests (default " << COMPAREALPHA << ")" << endl;
+	cerr << "  --threshold  percent a median must move to count (default " << COMPARETHRESHOLD << ")" << endl;
+	cerr << "  --min-ms     phases faster than this many ms per step aren't judged (default " << COMPAREMINMS << ")" << endl;
+	cerr << "Files before -- are the baseline, files after it the new runs; every math_bench file is one run." << endl;
+	cerr << "Exits with 1 if a benchmark or phase got significantly slower, 2 if the files can't be compared." << endl;
+}
+
+int main(int argc, char** argv) {
+
+	CompareOptions options;
+	options.alpha = COMPAREALPHA;
+	options.threshold = COMPARETHRESHOLD;
+	options.minMs = COMPAREMINMS;
+	vector<string> paths[2];
+	bool separated = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--") == 0 && !separated) {
+			separated = true;
+			continue;
+		}
+		if (strncmp(arg, "--", 2) != 0) {
+			paths[separated].push_back(arg);
+			continue;
+		}
+
+		char *end = NULL;
+		double number = value ? strtod(value, &end) : 0.0;
+		bool ok = value != NULL && end != value && *end == '\0' && number >= 0.0;
+		if (ok && strcmp(arg, "--alpha") == 0)
+			options.alpha = number;
+		else if (ok && strcmp(arg, "--threshold") == 0)
+			options.threshold = number;
+		else if (ok && strcmp(arg, "--min-ms") == 0)
+			options.minMs = number;
+		else {
+			if (strcmp(arg, "--help") != 0)
+				cerr << "bad argument: " << arg << (value ? string(" ") + value : string()) << endl;
+			printUsage(argv[0]);
+			return 2;
+		}
+		i++;
+	}
+
+	// Without --, the first of two files is the baseline
+	if (!separated && paths[0].size() == 2) {
+		paths[1].push_back(paths[0][1]);
+		paths[0].pop_back();
+	}
+	if (paths[0].empty() || paths[1].empty()) {
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	BenchmarkFile sides[2];
+	string kind;
+	for (int side = 0; side < 2; side++)
+		for (size_t f = 0; f < paths[side].size(); f++)
+			if (!loadBenchmarks(paths[side][f], sides[side], kind))
+				return 2;
+	const BenchmarkFile &base = sides[0], &next = sides[1];
+
+	vector<Comparison> comparisons;
+	vector<string> unmatched;
+	for (BenchmarkFile::const_iterator b = base.begin(); b != base.end(); ++b) {
+		BenchmarkFile::const_iterator n = next.find(b->first);
+		if (n == next.end()) {
+			unmatched.push_back(b->first + ": only in the baseline");
+			continue;
+		}
+
+		const Benchmark &before = b->second, &after = n->second;
+		compareRuns(b->first, before.runs, after.runs, true, comparisons);
+
+		map< string, vector<double> >::const_iterator phase;
+		for (phase = before.phases.begin(); phase != before.phases.end(); ++phase) {
+			map< string, vector<double> >::const_iterator match = after.phases.find(phase->first);
+			if (match == after.phases.end())
+				continue;
+			bool judge = max(median(phase->second), median(match->second)) >= options.minMs;
+			compareRuns("    " + phase->first, phase->second, match->second, judge, comparisons);
+		}
+	}
+	for (BenchmarkFile::const_iterator n = next.begin(); n != next.end(); ++n)
+		if (base.find(n->first) == base.end())
+			unmatched.push_back(n->first + ": only in the new runs");
+
+	int numTests = adjustHolm(comparisons);
+
+	const char *unit = kind == "particle_bench" ? "ns/particle/step (phases in ms/step)" : "ns/element";
+	cout << "Comparing " << paths[1].size() << " new file" << (paths[1].size() > 1 ? "s" : "") << " against "
+		 << paths[0].size() << " baseline file" << (paths[0].size() > 1 ? "s" : "") << ", in " << unit << endl;
+	char line[220];
+	snprintf(line, sizeof(line), "%-40s %12s %12s %9s %8s %8s", "Benchmark", "baseline", "new", "delta", "p", "Holm p");
+	cout << line << endl;
+
+	int regressions = 0, powerless = 0;
+	for (size_t i = 0; i < comparisons.size(); i++) {
+		regressions += printComparison(comparisons[i], options);
+		if (comparisons[i].judge && numTests*smallestP(comparisons[i].n1, comparisons[i].n2) >= options.alpha)
+			powerless++;
+	}
+	for (size_t i = 0; i < unmatched.size(); i++)
+		cout << unmatched[i] << endl;
+
+	// Five runs a side can't get a single test under p = 0.008, let alone
+	// hundreds of them after the correction
+	if (powerless > 0)
+		cout << powerless << " of the " << numTests << " tests have too few runs to get under alpha = " << options.alpha
+			 << " after the correction; use more repeats (or more math_bench files)" << endl;
+
+	if (regressions > 0) {
+		cout << regressions << " significant regression" << (regressions > 1 ? "s" : "") << endl;
+		return 1;
+	}
+	cout << "No significant regressions" << endl;
+	return 0;
+
+} // end main
@@ -0,0 +1,347 @@
+// Microbenchmark of the math in helper.hpp and trimesh.hpp: Vec3f arithmetic,
+// Mat4x4 * Vec3f, rotateX and rotateY, random(), range(), step() and sgn().
+// Each primitive runs over arrays of inputs drawn like the ones the scenes
+// feed it, and its results are kept from being optimized away, so the time
+// per element is what the primitive costs in a loop. A replacement (SIMD or
+// approximate) can be added to the table as its own entry and compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+
+using namespace std;
+
+#define MATHELEMENTS 4096		// inputs per array, small enough to stay in cache
+#define MATHSAMPLES 9			// timed samples per primitive
+#define MATHSAMPLEMS 20.0		// a sample runs the primitive over the inputs for at least this long
+
+//----------------------------------------------------------------------------
+// functions for keeping the compiler from dropping work whose results are
+// never used. keep makes it assume a value is read; clobber that any memory
+// may be.
+
+#if defined(__GNUC__) || defined(__clang__)
+template<typename T> static inline void keep(const T &value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+static inline void clobber() {
+	asm volatile("" : : : "memory");
+}
+#else
+static volatile char keepSink;
+template<typename T> static inline void keep(const T &value) {
+	keepSink = *(const volatile char *)&value;
+}
+static inline void clobber() {
+	keepSink = keepSink;
+}
+#endif
+
+//----------------------------------------------------------------------------
+// Inputs, drawn once with a fixed seed
+
+static struct {
+	int count;
+	vector<Vec3f> positions;	// x and z across the scenes' floor, y up to where balls drop from
+	vector<Vec3f> velocities;	// up to 10 per axis, an eighth of them at rest
+	vector<Vec3f> outputs;
+	vector<float> angles;		// camera angles in degrees
+	vector<float> mins, maxes;	// ranges like the emitters' (lifetimes, sizes, speeds)
+	vector<float> fractions;	// in [0, 1], like color mixes
+	vector<float> values;		// results of the float primitives
+	vector<int> signs;
+	Mat4x4 camera;
+} in;
+
+static void makeInputs(int count) {
+	threadRandom().start(randomKey(RANDOMSEED, 0));
+	in.count = count;
+	in.positions.resize(count);
+	in.velocities.resize(count);
+	in.outputs.resize(count);
+	in.angles.resize(count);
+	in.mins.resize(count);
+	in.maxes.resize(count);
+	in.fractions.resize(count);
+	in.values.resize(count);
+	in.signs.resize(count);
+
+	for (int i = 0; i < count; i++) {
+		in.positions[i] = Vec3f(100*random(10000, true), 2750*random(10000, false), 100*random(10000, true));
+		if (i % 8 == 0)
+			in.velocities[i] = Vec3f(0, 0, 0);
+		else
+			in.velocities[i] = Vec3f(10*random(10000, true), 10*random(10000, true), 10*random(10000, true));
+		in.angles[i] = range(0, 360);
+		in.mins[i] = range(0.5, 2);
+		in.maxes[i] = in.mins[i] + range(0, 3);
+		in.fractions[i] = random(1000, false);
+	}
+
+	Mat4x4 y = rotateY(30), x = rotateX(20);
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++) {
+			float sum = 0;
+			for (int k = 0; k < 4; k++)
+				sum += x.m[4*k + row]*y.m[4*column + k];
+			in.camera.m[4*column + row] = sum;
+		}
+}
+
+//----------------------------------------------------------------------------
+// The primitives, each run once over the inputs
+
+static void vecAdd() {
+	for (int i = 0; i < in.count; i++)
+		in.outputs[i] += in.velocities[i];
+	clobber();
+}
+
+static void vecSubtract() {
+	for (int i = 0; i < in.count; i++)
+		in.outputs[i] = in.positions[i] - in.velocities[i];
+	clobber();
+}
+
+static void vecScale() {
+	float dt = 1.0f/120.0f;
+	for (int i = 0; i < in.count; i++)
+		in.outputs[i] = in.velocities[i]*dt;
+	clobber();
+}
+
+static void vecDot() {
+	float sum = 0;
+	for (int i = 0; i < in.count; i++)
+		sum += in.positions[i].dot(in.velocities[i]);
+	keep(sum);
+}
+
+static void vecCross() {
+	for (int i = 0; i < in.count; i++)
+		in.outputs[i] = in.positions[i].cross(in.velocities[i]);
+	clobber();
+}
+
+static void vecLength() {
+	double sum = 0;
+	for (int i = 0; i < in.count; i++)
+		sum += in.velocities[i].len();
+	keep(sum);
+}
+
+static void vecNormalize() {
+	for (int i = 0; i < in.count; i++) {
+		in.outputs[i] = in.velocities[i];
+		in.outputs[i].normalize();
+	}
+	clobber();
+}
+
+static void matTimesVec() {
+	for (int i = 0; i < in.count; i++)
+		in.outputs[i] = in.camera*in.positions[i];
+	clobber();
+}
+
+static void rotateXs() {
+	for (int i = 0; i < in.count; i++) {
+		Mat4x4 m = rotateX(in.angles[i]);
+		keep(m);
+	}
+}
+
+static void rotateYs() {
+	for (int i = 0; i < in.count; i++) {
+		Mat4x4 m = rotateY(in.angles[i]);
+		keep(m);
+	}
+}
+
+static void randoms() {
+	for (int i = 0; i < in.count; i++)
+		in.values[i] = (float)random(10000, i & 1);
+	clobber();
+}
+
+static void ranges() {
+	for (int i = 0; i < in.count; i++)
+		in.values[i] = range(in.mins[i], in.maxes[i]);
+	clobber();
+}
+
+static void steps() {
+	for (int i = 0; i < in.count; i++)
+		in.values[i] = step(in.mins[i], in.maxes[i], in.fractions[i]);
+	clobber();
+}
+
+static void sgns() {
+	for (int i = 0; i < in.count; i++)
+		in.signs[i] = sgn(in.velocities[i][1]);
+	clobber();
+}
+
+typedef struct {
+	const char *name;
+	void (*run)();
+} MathBench;
+
+static const MathBench mathBenches[] = {
+	{ "vec add", vecAdd },
+	{ "vec subtract", vecSubtract },
+	{ "vec scale", vecScale },
+	{ "vec dot", vecDot },
+	{ "vec cross", vecCross },
+	{ "vec len", vecLength },
+	{ "vec normalize", vecNormalize },
+	{ "mat4x4 * vec3f", matTimesVec },
+	{ "rotateX", rotateXs },
+	{ "rotateY", rotateYs },
+	{ "random", randoms },
+	{ "range", ranges },
+	{ "step", steps },
+	{ "sgn", sgns },
+};
+
+//----------------------------------------------------------------------------
+
+// Times a primitive: finds how many passes over the inputs take sampleMs,
+// then returns the nanoseconds per element of that many passes, samples times
+static vector<double> timeBench(const MathBench &bench, int samples, double sampleMs) {
+	typedef std::chrono::steady_clock Clock;
+	long passes = 1;
+	for (;;) {
+		Clock::time_point start = Clock::now();
+		for (long pass = 0; pass < passes; pass++)
+			bench.run();
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		if (ms >= sampleMs)
+			break;
+		passes *= 2;
+	}
+
+	vector<double> times;
+	for (int sample = 0; sample < samples; sample++) {
+		Clock::time_point start = Clock::now();
+		for (long pass = 0; pass < passes; pass++)
+			bench.run();
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		times.push_back(ns/((double)passes*in.count));
+	}
+	return times;
+}
+
+static double median(vector<double> values) {
+	sort(values.begin(), values.end());
+	size_t middle = values.size()/2;
+	return values.size() % 2 ? values[middle] : 0.5*(values[middle - 1] + values[middle]);
+}
+
+static void printUsage(const char *program) {
+	cerr << "usage: " << program << " [--filter text] [--elements n] [--samples n] [--sample-ms ms] [--out file]" << endl;
+	cerr << "  --filter     only run primitives whose name contains text" << endl;
+	cerr << "  --elements   inputs per array (default " << MATHELEMENTS << ")" << endl;
+	cerr << "  --samples    timed samples per primitive (default " << MATHSAMPLES << ")" << endl;
+	cerr << "  --sample-ms  least milliseconds per sample (default " << MATHSAMPLEMS << ")" << endl;
+	cerr << "  --out        also write every sample to a JSON file" << endl;
+}
+
+int main(int argc, char** argv) {
+
+	string filter, outPath;
+	int elements = MATHELEMENTS;
+	int samples = MATHSAMPLES;
+	double sampleMs = MATHSAMPLEMS;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		char *end = NULL;
+
+		bool ok = value != NULL;
+		if (ok && strcmp(arg, "--filter") == 0)
+			filter = value;
+		else if (ok && strcmp(arg, "--out") == 0)
+			outPath = value;
+		else if (ok && strcmp(arg, "--elements") == 0) {
+			elements = strtol(value, &end, 10);
+			ok = *end == '\0' && elements > 0;
+		}
+		else if (ok && strcmp(arg, "--samples") == 0) {
+			samples = strtol(value, &end, 10);
+			ok = *end == '\0' && samples > 0;
+		}
+		else if (ok && strcmp(arg, "--sample-ms") == 0) {
+			sampleMs = strtod(value, &end);
+			ok = end != value && *end == '\0' && sampleMs > 0.0;
+		}
+		else
+			ok = false;
+
+		if (!ok) {
+			if (strcmp(arg, "--help") != 0 && strcmp(arg, "-h") != 0)
+				cerr << "bad argument: " << arg << (value ? string(" ") + value : string()) << endl;
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		i++;
+	}
+
+	makeInputs(elements);
+
+	ofstream out;
+	if (!outPath.empty()) {
+		out.open(outPath.c_str());
+		if (!out) {
+			cerr << "couldn't write " << outPath << endl;
+			return EXIT_FAILURE;
+		}
+		out << "{" << endl;
+		out << "  \"benchmark\": \"math_bench\", \"elements\": " << elements << ", \"samples\": " << samples << "," << endl;
+		out << "  \"results\": [";
+	}
+
+	char line[160];
+	snprintf(line, sizeof(line), "%-16s %12s %14s", "Primitive", "ns/element", "Melements/s");
+	cout << line << endl;
+
+	bool first = true;
+	int numBenches = sizeof(mathBenches)/sizeof(mathBenches[0]);
+	for (int b = 0; b < numBenches; b++) {
+		const MathBench &bench = mathBenches[b];
+		if (string(bench.name).find(filter) == string::npos)
+			continue;
+
+		vector<double> times = timeBench(bench, samples, sampleMs);
+		double ns = median(times);
+		snprintf(line, sizeof(line), "%-16s %12.3f %14.1f", bench.name, ns, 1e3/ns);
+		cout << line << endl;
+
+		if (out.is_open()) {
+			out << (first ? "" : ",") << endl << "    {\"name\": \"" << bench.name << "\", \"nsPerElement\": " << ns << ", \"runs\": [";
+			for (size_t i = 0; i < times.size(); i++)
+				out << (i > 0 ? ", " : "") << times[i];
+			out << "]}";
+			first = false;
+		}
+	}
+
+	if (out.is_open()) {
+		out << endl << "  ]" << endl << "}" << endl;
+		if (!out) {
+			cerr << "couldn't write " << outPath << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,30 @@
+// Conversions between floats and the compact formats particle attributes are
+// stored in: 8- and 16-bit normalized integers. Each of them matches an OpenGL
+// vertex format, so the attributes upload as is.
+
+#ifndef PACK_HPP
+#define PACK_HPP 1
+
+#include <stdint.h>
+
+// [0, 1] to 0..255 (GL_UNSIGNED_BYTE, normalized), clamping
+inline uint8_t packUnorm8(float x) {
+	x = x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+	return (uint8_t)(x*255.0f + 0.5f);
+}
+
+inline float unpackUnorm8(uint8_t x) {
+	return x*(1.0f/255.0f);
+}
+
+// [0, 1] to 0..65535 (GL_UNSIGNED_SHORT, normalized), clamping
+inline uint16_t packUnorm16(float x) {
+	x = x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+	return (uint16_t)(x*65535.0f + 0.5f);
+}
+
+inline float unpackUnorm16(uint16_t x) {
+	return x*(1.0f/65535.0f);
+}
+
+#endif
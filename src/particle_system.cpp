@@ -0,0 +1,1420 @@
+// Particle simulation core, shared by every demo scene and the headless tools
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <vector>
+
+#include "particle_system.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+using std::cout;
+using std::endl;
+
+// Particles a group has room for when it first grows; after that it doubles.
+// Indices within a group are ints, which caps a group at INT_MAX particles.
+#define GROUPCAPACITY 1024
+
+// Grounded water and balls shrink by these sizes per second, and die once
+// smaller than the minimum sizes
+#define WATERSHRINK 60
+#define WATERMINSIZE 10
+#define BALLSHRINK 35
+#define BALLMINSIZE 5
+
+// Random numbers set aside in an emitter's stream for each particle it spawns
+#define SPAWNDRAWS 32
+
+// Which of its SPAWNDRAWS numbers a spawned particle uses for what
+enum {
+	DRAW_RADIUS,
+	DRAW_ANGLE,
+	DRAW_SPEED,
+	DRAW_SIGNX,
+	DRAW_SIGNZ,
+	DRAW_VELOCITY,
+	DRAW_COLOR = DRAW_VELOCITY + 3,
+	DRAW_COLOREND = DRAW_COLOR + 4,
+	DRAW_SIZE = DRAW_COLOREND + 4,
+	DRAW_BLUR,
+	DRAW_COLORSPEED,
+	DRAW_LIFETIME,
+	NUMDRAWS
+};
+static_assert(NUMDRAWS <= SPAWNDRAWS, "a spawned particle uses more random numbers than SPAWNDRAWS");
+
+// Kinds of random streams, keyed together with the seed and frame
+enum {
+	STREAM_SCENE,		// what the scene draws between spawns
+	STREAM_EMITTER,		// one per emitter id
+	STREAM_NOISE		// turbulence of fire and smoke
+};
+
+// The vector kernels treat the particle arrays as flat float arrays
+static_assert(sizeof(Vec3f) == 3*sizeof(float), "Vec3f must be three packed floats");
+
+// The viewer's vertex layouts rely on this packing
+static_assert(sizeof(DynamicVertex) == 16, "DynamicVertex must be 16 packed bytes");
+static_assert(sizeof(StaticVertex) == 4, "StaticVertex must be 4 packed bytes");
+static_assert(sizeof(SpawnVertex) == 48, "SpawnVertex must be 48 packed bytes");
+
+//----------------------------------------------------------------------------
+
+ParticleGroup::ParticleGroup() : force(0), numParticles(0), numAsleep(0), capacity(0), staticFrom(0), stateless(false), ring(false), interpolated(false), first(0),
+	particles(NULL), colors(NULL), lightings(NULL), sizes(NULL), blurs(NULL),
+	velocities(NULL), colorStarts(NULL), colorChanges(NULL), colorMixes(NULL), colorSpeeds(NULL),
+	ages(NULL), agingRates(NULL), flags(NULL), dead(NULL), ids(NULL), moved(NULL),
+	births(NULL), expiries(NULL), settled(NULL), previous(NULL) {
+}
+
+ParticleGroup::~ParticleGroup() {
+	delete[] particles;
+	delete[] colors;
+	delete[] lightings;
+	delete[] sizes;
+	delete[] blurs;
+
+	delete[] velocities;
+	delete[] colorStarts;
+	delete[] colorChanges;
+	delete[] colorMixes;
+	delete[] colorSpeeds;
+	delete[] ages;
+	delete[] agingRates;
+	delete[] flags;
+	delete[] dead;
+	delete[] ids;
+	delete[] births;
+	delete[] moved;
+	delete[] expiries;
+	delete[] settled;
+	delete[] previous;
+}
+
+int ParticleGroup::bytesPerParticle() const {
+	return sizeof(*particles) + sizeof(*colors) + sizeof(*lightings) + sizeof(*sizes) + sizeof(*blurs) +
+		sizeof(*velocities) + sizeof(*colorStarts) + sizeof(*colorChanges) + sizeof(*colorMixes) +
+		sizeof(*colorSpeeds) + sizeof(*ages) + sizeof(*agingRates) + sizeof(*flags) + sizeof(*dead) + sizeof(*ids) +
+		sizeof(*moved) + (births ? sizeof(*births) : 0) + (expiries ? sizeof(*expiries) : 0) +
+		(settled ? sizeof(*settled) : 0) + (interpolated ? sizeof(*previous) : 0);
+}
+
+long long ParticleGroup::bytes() const {
+	return (long long)capacity*bytesPerParticle() + expiry.bytes();
+}
+
+// Mixes an RGBA8 color mix of the way from a start to an end color. The blend
+// is 8-bit fixed point, which is all the precision RGBA8 keeps.
+static inline void mixColor(uint8_t color[4], const uint8_t start[4], const uint8_t end[4], float mix) {
+	int weight = (int)(std::min(mix, 1.0f)*256.0f + 0.5f);
+	for (int k = 0; k < 4; k++)
+		color[k] = (uint8_t)((start[k]*(256 - weight) + end[k]*weight + 128) >> 8);
+}
+
+// Moves the first count items of an array into a new array of the given capacity
+template<typename T>
+static void grow(T *&array, int count, int capacity) {
+	T *bigger = new T[capacity];
+	if (count > 0)
+		memcpy(bigger, array, count*sizeof(T));
+	delete[] array;
+	array = bigger;
+}
+
+void ParticleGroup::reserve(int capacity) {
+	// A ring may use any slot
+	int used = extent();
+
+	grow(particles, used, capacity);
+	grow(colors, used, capacity);
+	grow(lightings, used, capacity);
+	grow(sizes, used, capacity);
+	grow(blurs, used, capacity);
+
+	grow(velocities, used, capacity);
+	grow(colorStarts, used, capacity);
+	grow(colorChanges, used, capacity);
+	grow(colorMixes, used, capacity);
+	grow(colorSpeeds, used, capacity);
+	grow(ages, used, capacity);
+	grow(agingRates, used, capacity);
+	grow(flags, used, capacity);
+	grow(dead, used, capacity);
+	grow(ids, used, capacity);
+	grow(moved, used, capacity);
+	if (stateless)
+		grow(births, used, capacity);
+	if (queuesDeaths())
+		grow(expiries, used, capacity);
+	if (shrinkRate() > 0.0f)
+		grow(settled, used, capacity);
+	if (interpolated)
+		grow(previous, used, capacity);
+
+	this->capacity = capacity;
+}
+
+// Resets the slots in [begin, end) for new particles
+void ParticleGroup::clear(int begin, int end) {
+	for (int i = begin; i < end; i++) {
+		ages[i] = 0.0f;
+		agingRates[i] = 0.0f;
+		colorMixes[i] = 0.0f;
+		flags[i] = 0;
+		dead[i] = false;
+		moved[i] = false;
+	}
+	if (expiries) {
+		for (int i = begin; i < end; i++)
+			expiries[i].bucket = -1;
+	}
+}
+
+int ParticleGroup::add(int count) {
+	if (ring)
+		return addToRing(count);
+
+	if (numParticles + count > capacity) {
+		long long bigger = std::max(2*(long long)capacity, (long long)GROUPCAPACITY);
+		while (bigger < numParticles + count)
+			bigger *= 2;
+		reserve((int)std::min(bigger, (long long)INT_MAX));
+	}
+
+	int first = numParticles;
+	clear(first, first + count);
+	numParticles += count;
+	touchStatic(first);
+	return first;
+}
+
+// function for adding a batch at a ring's newest end. Free slots are the ones
+// after the newest particle up to the end of the arrays and the ones before
+// the oldest; when the batch doesn't fit after the newest it starts over at
+// index 0, and the slots it skips are padded with dead particles.
+int ParticleGroup::addToRing(int count) {
+	if (numParticles == 0)
+		first = 0;
+	int head = first + numParticles;
+	int begin = -1, padding = 0;
+
+	if (head < capacity) {
+		if (head + count <= capacity)
+			begin = head;
+		else if (count <= first) {
+			begin = 0;
+			padding = capacity - head;
+		}
+	}
+	else if (head - capacity + count <= first)
+		begin = head - capacity;
+
+	if (begin < 0) {
+		// Grow, and move the particles that wrapped around to follow the rest
+		int oldCapacity = capacity;
+		long long bigger = std::max(2*(long long)capacity, (long long)GROUPCAPACITY);
+		while (bigger < (long long)first + numParticles + count)
+			bigger *= 2;
+		reserve((int)std::min(bigger, (long long)INT_MAX));
+
+		for (int i = 0; i < head - oldCapacity; i++) {
+			move(i, oldCapacity + i);
+			dead[oldCapacity + i] = dead[i];
+		}
+		begin = head;
+	}
+
+	if (padding > 0) {
+		clear(head, capacity);
+		for (int i = head; i < capacity; i++) {
+			particles[i] = Vec3f(0.0, 0.0, 0.0);
+			if (interpolated)
+				previous[i] = particles[i];
+			velocities[i] = Vec3f(0.0, 0.0, 0.0);
+			memset(colors[i], 0, sizeof(colors[i]));
+			memset(colorStarts[i], 0, sizeof(colorStarts[i]));
+			memset(colorChanges[i], 0, sizeof(colorChanges[i]));
+			lightings[i] = 0;
+			sizes[i] = 0;
+			blurs[i] = 0;
+			colorSpeeds[i] = 0.0f;
+			ids[i] = 0;
+			if (births)
+				births[i] = 0.0f;
+			if (settled)
+				settled[i] = 0.0f;
+			flags[i] = PARTICLE_PADDING;
+			dead[i] = true;
+		}
+	}
+
+	// The new slots are packed as moved ones, since they need not follow
+	// staticFrom
+	clear(begin, begin + count);
+	memset(&moved[begin], 1, count*sizeof(bool));
+	numParticles += padding + count;
+	return begin;
+}
+
+//----------------------------------------------------------------------------
+// function for copying every attribute of a particle into another slot
+void ParticleGroup::move(int from, int to) {
+	particles[to] = particles[from];
+	if (interpolated)
+		previous[to] = previous[from];
+	memcpy(colors[to], colors[from], sizeof(colors[to]));
+	lightings[to] = lightings[from];
+	sizes[to] = sizes[from];
+	blurs[to] = blurs[from];
+
+	velocities[to] = velocities[from];
+	memcpy(colorStarts[to], colorStarts[from], sizeof(colorStarts[to]));
+	memcpy(colorChanges[to], colorChanges[from], sizeof(colorChanges[to]));
+	colorMixes[to] = colorMixes[from];
+	colorSpeeds[to] = colorSpeeds[from];
+	ages[to] = ages[from];
+	agingRates[to] = agingRates[from];
+	flags[to] = flags[from];
+	ids[to] = ids[from];
+	moved[to] = true;
+	if (births)
+		births[to] = births[from];
+	if (settled)
+		settled[to] = settled[from];
+	if (expiries)
+		expiry.move(from, to, expiries);
+}
+
+// function for removing every particle marked dead. Groups whose particles
+// sleep compact their sleeping and awake particles apart, then move the last
+// awake ones into the slots the sleeping ones left.
+int ParticleGroup::compact(ThreadPool &pool, int chunkSize) {
+	if (ring)
+		return retire(pool, chunkSize);
+
+	int numAsleepDead = compactRange(pool, chunkSize, 0, numAsleep);
+	int numAwakeDead = compactRange(pool, chunkSize, numAsleep, numParticles);
+	int asleep = numAsleep - numAsleepDead;
+	int numAwake = numParticles - numAsleep - numAwakeDead;
+
+	int numMoved = std::min(numAsleepDead, numAwake);
+	int from = numAsleep + numAwake - numMoved;
+	pool.parallelFor(numMoved, chunkSize, [this, from, asleep](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			move(from + i, asleep + i);
+			dead[asleep + i] = false;
+		}
+	});
+
+	numAsleep = asleep;
+	numParticles = asleep + numAwake;
+	return numAsleepDead + numAwakeDead;
+}
+
+// function for removing the particles marked dead from [first, last), leaving
+// the survivors in order at its start; returns how many were dead. The
+// survivors at or past the new end fill the holes before it, the k-th
+// survivor going to the k-th hole; prefix sums of per-chunk counts give every
+// chunk its first rank, and since sources and holes never overlap the chunks
+// move in parallel.
+int ParticleGroup::compactRange(ThreadPool &pool, int chunkSize, int first, int last) {
+	int count = last - first;
+	int numChunks = (count + chunkSize - 1)/chunkSize;
+	std::vector<int> holes(numChunks + 1, 0);
+	std::vector<int> survivors(numChunks + 1, 0);
+
+	// Count the dead to find where the survivors will end, dropping the ones
+	// that died before their lifetimes ended from the expiry queue
+	pool.parallelFor(count, chunkSize, [this, &holes, first, chunkSize](int begin, int end) {
+		int numDead = 0;
+		for (int i = first + begin; i < first + end; i++) {
+			if (dead[i]) {
+				if (expiries)
+					expiry.cancel(expiries[i]);
+				numDead++;
+			}
+		}
+		holes[begin/chunkSize + 1] = numDead;
+	});
+
+	int numDead = 0;
+	for (int chunk = 1; chunk <= numChunks; chunk++)
+		numDead += holes[chunk];
+	if (numDead == 0)
+		return 0;
+	int numAlive = first + count - numDead;
+
+	// Count the holes before numAlive and the survivors after it in each chunk
+	pool.parallelFor(count, chunkSize, [this, &holes, &survivors, first, numAlive, chunkSize](int begin, int end) {
+		int numHoles = 0, numSurvivors = 0;
+		for (int i = first + begin; i < first + end; i++) {
+			if (i < numAlive)
+				numHoles += dead[i];
+			else
+				numSurvivors += !dead[i];
+		}
+		holes[begin/chunkSize + 1] = numHoles;
+		survivors[begin/chunkSize + 1] = numSurvivors;
+	});
+
+	for (int chunk = 1; chunk <= numChunks; chunk++) {
+		holes[chunk] += holes[chunk - 1];
+		survivors[chunk] += survivors[chunk - 1];
+	}
+
+	// Move each chunk's survivors into the holes of the same ranks
+	pool.parallelFor(count, chunkSize, [this, &holes, &survivors, first, numAlive, chunkSize](int begin, int end) {
+		int chunk = begin/chunkSize;
+		int rank = survivors[chunk];
+		if (rank == survivors[chunk + 1])
+			return;
+
+		// Find this chunk's first hole: the chunk holding it, then the hole itself
+		int holeChunk = (int)(std::upper_bound(holes.begin(), holes.end(), rank) - holes.begin()) - 1;
+		int hole = first + holeChunk*chunkSize;
+		int skip = rank - holes[holeChunk];
+		while (!dead[hole] || skip-- > 0)
+			hole++;
+
+		for (int i = std::max(first + begin, numAlive); i < first + end; i++) {
+			if (dead[i])
+				continue;
+			while (!dead[hole])
+				hole++;
+			move(i, hole++);
+		}
+	});
+
+	// Every slot left is alive now
+	memset(&dead[first], 0, (numAlive - first)*sizeof(bool));
+	return numDead;
+}
+
+//----------------------------------------------------------------------------
+// functions for putting particles to sleep. A sleeping
+// particle keeps the size it had when it fell asleep; its size at any later
+// time follows from that and the time it fell asleep.
+bool ParticleGroup::sleeps() const {
+	return force == FORCE_WATER || force == FORCE_BALL || force == FORCE_BOUNCE;
+}
+
+float ParticleGroup::shrinkRate() const {
+	if (force == FORCE_WATER)
+		return WATERSHRINK;
+	if (force == FORCE_BALL)
+		return BALLSHRINK;
+	return 0.0f;
+}
+
+bool ParticleGroup::queuesDeaths() const {
+	return expires() || shrinkRate() > 0.0f;
+}
+
+float ParticleGroup::sleepingSize(int index, double time) const {
+	float size = unpackSize(sizes[index]);
+	return settled ? size - shrinkRate()*(float)(time - settled[index]) : size;
+}
+
+// Water older than two seconds steps its color mix toward 1 by colorSpeed*dt
+// of what is left every step, so what is left decays exponentially. A
+// sleeping particle's age stays as it was when it fell asleep, which gives
+// how much of its sleep came before the two seconds.
+float ParticleGroup::sleepingMix(int index, double time) const {
+	if (force != FORCE_WATER || agingRates[index] <= 0.0f)
+		return colorMixes[index];
+	double lived = ages[index]/agingRates[index];
+	double mixing = (time - settled[index]) - std::max(0.0, 2.0 - lived);
+	if (mixing <= 0.0)
+		return colorMixes[index];
+	return 1.0f - (1.0f - colorMixes[index])*(float)exp(-colorSpeeds[index]*mixing);
+}
+
+// Swaps two particles through the slot past the last one
+void ParticleGroup::swap(int a, int b) {
+	if (numParticles == capacity)
+		reserve((int)std::min(std::max(2*(long long)capacity, (long long)GROUPCAPACITY), (long long)INT_MAX));
+	move(a, numParticles);
+	move(b, a);
+	move(numParticles, b);
+}
+
+// Notes the time a particle fell asleep at and queues the moment it shrinks
+// out of existence, unless its lifetime ends first. Like the stepped kernels,
+// which check the size before shrinking it, the particle dies once its size
+// would drop under the minimum.
+void ParticleGroup::settle(int index, double time) {
+	if (settled)
+		settled[index] = time;
+	if (interpolated)
+		previous[index] = particles[index];
+
+	float rate = shrinkRate();
+	if (rate <= 0.0f)
+		return;
+	float minSize = force == FORCE_WATER ? WATERMINSIZE : BALLMINSIZE;
+	double death = time + (unpackSize(sizes[index]) - minSize)/rate;
+	if (expiries[index].bucket < 0 || death < expiry.when(expiries[index])) {
+		expiry.cancel(expiries[index]);
+		expiry.schedule(index, death, expiries);
+	}
+}
+
+void ParticleGroup::fallAsleep(ThreadPool &pool, int chunkSize, double time) {
+	if (!sleeps())
+		return;
+
+	int first = numAsleep;
+	int numChunks = (numParticles - first + chunkSize - 1)/chunkSize;
+	std::vector< std::vector<int> > settling(numChunks);
+	pool.parallelFor(numParticles - first, chunkSize, [this, &settling, first, chunkSize](int begin, int end) {
+		std::vector<int> &found = settling[begin/chunkSize];
+		for (int i = first + begin; i < first + end; i++)
+			if (flags[i] & PARTICLE_ASLEEP)
+				found.push_back(i);
+	});
+
+	// Swap each with the first awake particle, in order, so that one is
+	// never still to be moved
+	for (int chunk = 0; chunk < numChunks; chunk++) {
+		for (size_t k = 0; k < settling[chunk].size(); k++) {
+			int index = settling[chunk][k];
+			if (index != numAsleep)
+				swap(index, numAsleep);
+			settle(numAsleep++, time);
+		}
+	}
+}
+
+int ParticleGroup::awakeRanges(int bounds[4]) const {
+	if (ring)
+		return ranges(bounds);
+	bounds[0] = numAsleep;
+	bounds[1] = numParticles;
+	return numParticles > numAsleep ? 1 : 0;
+}
+
+// function for retiring the dead at a ring's oldest end. The dead are still
+// dropped from the expiry queue wherever they are, so it can't hand them back.
+int ParticleGroup::retire(ThreadPool &pool, int chunkSize) {
+	int bounds[4];
+	int numRanges = expiries ? ranges(bounds) : 0;
+	for (int range = 0; range < numRanges; range++) {
+		int offset = bounds[2*range];
+		pool.parallelFor(bounds[2*range + 1] - offset, chunkSize, [this, offset](int begin, int end) {
+			for (int i = offset + begin; i < offset + end; i++) {
+				if (dead[i])
+					expiry.cancel(expiries[i]);
+			}
+		});
+	}
+
+	int numRetired = 0;
+	while (numParticles > 0 && dead[first]) {
+		numRetired += !(flags[first] & PARTICLE_PADDING);
+		first = first + 1 < capacity ? first + 1 : 0;
+		numParticles--;
+	}
+	return numRetired;
+}
+
+int ParticleGroup::ranges(int bounds[4]) const {
+	if (numParticles == 0)
+		return 0;
+
+	int head = first + numParticles;
+	bounds[0] = first;
+	bounds[1] = std::min(head, extent());
+	if (head <= extent())
+		return 1;
+	bounds[2] = 0;
+	bounds[3] = head - capacity;
+	return 2;
+}
+
+// functions for packing particles into render vertices in one pass
+void ParticleGroup::packDynamic(int begin, int end, DynamicVertex *vertices, float blend, double time) const {
+	for (int i = begin; i < end; i++) {
+		DynamicVertex &vertex = vertices[i - begin];
+		if (interpolated) {
+			for (int k = 0; k < 3; k++)
+				vertex.position[k] = previous[i][k] + (particles[i][k] - previous[i][k])*blend;
+		}
+		else
+			vertex.position = particles[i];
+		if (i < numAsleep && force == FORCE_WATER)
+			mixColor(vertex.color, colorStarts[i], colorChanges[i], sleepingMix(i, time));
+		else
+			memcpy(vertex.color, colors[i], sizeof(vertex.color));
+		if (dead[i])
+			vertex.color[3] = 0;
+	}
+}
+
+void ParticleGroup::packStatic(int begin, int end, StaticVertex *vertices, double time) const {
+	for (int i = begin; i < end; i++) {
+		StaticVertex &vertex = vertices[i - begin];
+		vertex.size = i < numAsleep ? packSize(sleepingSize(i, time)) : sizes[i];
+		vertex.blur = blurs[i];
+		vertex.lighting = lightings[i];
+	}
+}
+
+void ParticleGroup::packSpawns(int begin, int end, SpawnVertex *vertices) const {
+	for (int i = begin; i < end; i++) {
+		SpawnVertex &vertex = vertices[i - begin];
+		vertex.position = particles[i];
+		memcpy(vertex.colorStart, colorStarts[i], sizeof(vertex.colorStart));
+		vertex.size = sizes[i];
+		vertex.blur = blurs[i];
+		vertex.lighting = lightings[i];
+		vertex.velocity = velocities[i];
+		memcpy(vertex.colorEnd, colorChanges[i], sizeof(vertex.colorEnd));
+		vertex.birth = births[i];
+		vertex.agingRate = agingRates[i];
+		vertex.colorSpeed = colorSpeeds[i];
+	}
+}
+
+bool ParticleGroup::expires() const {
+	return force >= FORCE_FIREWORK && force <= FORCE_BUBBLE;
+}
+
+//----------------------------------------------------------------------------
+// functions for queueing particles by the end of their lifetimes. A particle
+// dies in the step that takes the time past birth + lifetime, which is when
+// its age passes 1.
+void ParticleGroup::schedule(int first, int count, double time) {
+	if (!expires())
+		return;
+	for (int i = first; i < first + count; i++) {
+		if (agingRates[i] > 0.0f)
+			expiry.schedule(i, time + 1.0/agingRates[i], expiries);
+	}
+}
+
+void ParticleGroup::expire(double time) {
+	expiry.advance(time, expiries, [this](int i) { dead[i] = true; });
+}
+
+//----------------------------------------------------------------------------
+// function for stepping the particles in [begin, end) with the group's force
+void ParticleGroup::update(int begin, int end, double dt, const Vec3f origins[NUMFORCES], uint64_t noiseKey) {
+	// Stateless particles only expire, which expire takes care of
+	if (stateless)
+		return;
+
+	if (interpolated)
+		memcpy(&previous[begin], &particles[begin], (end - begin)*sizeof(Vec3f));
+
+	switch (force) {
+	case FORCE_FIREWORK:	updateFirework(begin, end, dt); break;
+	case FORCE_EXPLOSION:	updateExplosion(begin, end, dt); break;
+	case FORCE_WATER:		updateWater(begin, end, dt); break;
+	case FORCE_FIRE:		updateFire(begin, end, dt, origins[FORCE_FIRE], noiseKey); break;
+	case FORCE_SMOKE:		updateSmoke(begin, end, dt, origins[FORCE_SMOKE], noiseKey); break;
+	case FORCE_BUBBLE:		updateBubble(begin, end, dt); break;
+	case FORCE_BALL:		updateBall(begin, end, dt); break;
+	case FORCE_BOUNCE:		updateBounce(begin, end, dt); break;
+	default:
+		// Particles without a force only age
+		for (int i = begin; i < end; i++)
+			ages[i] += agingRates[i]*(float)dt;
+	}
+}
+
+// Mixes the RGBA8 colors of the particles in [begin, end) from their start and
+// end colors. The kernels only step the mixes, one float per particle, and
+// the vector loop computes exactly what mixColor does.
+void ParticleGroup::resolveColors(int begin, int end) {
+	int i = begin;
+
+#if SIMD_WIDTH > 1
+	for (; i + 4 <= end; i += 4)
+		simd::blendColors4(colors[i], colorStarts[i], colorChanges[i], &colorMixes[i]);
+#endif
+
+	for (; i < end; i++)
+		mixColor(colors[i], colorStarts[i], colorChanges[i], colorMixes[i]);
+}
+
+// Firework trails: gravity, shrink over life. The vector loop steps
+// SIMD_WIDTH particles at a time over the flattened x, y, z arrays; the
+// scalar loop finishes the rest with the same float math, so a particle
+// steps the same whichever loop it lands in.
+void ParticleGroup::updateFirework(int begin, int end, double dt) {
+	float delta = dt;
+	float fall = dt*dt*GRAVITY/2.0;
+	float pull = dt*GRAVITY;
+	int i = begin;
+
+#if SIMD_WIDTH > 1
+	// Along the flattened positions and velocities gravity only touches every
+	// third float, so SIMD_WIDTH particles take three vectors with these offsets
+	float falls[3*SIMD_WIDTH], pulls[3*SIMD_WIDTH];
+	for (int k = 0; k < 3*SIMD_WIDTH; k++) {
+		falls[k] = k%3 == 1 ? fall : 0.0f;
+		pulls[k] = k%3 == 1 ? pull : 0.0f;
+	}
+
+	for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+		simd::age(&ages[i], &agingRates[i], delta);
+
+		for (int k = 0; k < 3; k++) {
+			float *position = &particles[i][0] + k*SIMD_WIDTH;
+			float *velocity = &velocities[i][0] + k*SIMD_WIDTH;
+			simd::Floats v = simd::load(velocity);
+			simd::store(position, simd::add(simd::load(position), simd::sub(simd::mul(v, simd::set1(delta)), simd::load(falls + k*SIMD_WIDTH))));
+			simd::store(velocity, simd::sub(v, simd::load(pulls + k*SIMD_WIDTH)));
+		}
+
+		simd::stepMixes(&colorMixes[i], &colorSpeeds[i], delta);
+	}
+#endif
+
+	for (; i < end; i++) {
+		ages[i] += agingRates[i]*delta;
+
+		particles[i][0] += velocities[i][0]*delta;
+		particles[i][1] += velocities[i][1]*delta - fall;
+		particles[i][2] += velocities[i][2]*delta;
+
+		velocities[i][1] -= pull;
+		colorMixes[i] = step(colorMixes[i], 1.0f, colorSpeeds[i]*delta);
+	}
+
+	for (i = begin; i < end; i++)
+		setSize(i, (MAXSIZE/3.0f)*(1.0f - ages[i]));
+	resolveColors(begin, end);
+}
+
+// Explosion sparks: linear drag, vectorized like updateFirework
+void ParticleGroup::updateExplosion(int begin, int end, double dt) {
+	float delta = dt;
+	float drag = 2*dt;
+	int i = begin;
+
+#if SIMD_WIDTH > 1
+	for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+		simd::age(&ages[i], &agingRates[i], delta);
+
+		for (int k = 0; k < 3; k++) {
+			float *position = &particles[i][0] + k*SIMD_WIDTH;
+			float *velocity = &velocities[i][0] + k*SIMD_WIDTH;
+			simd::Floats v = simd::load(velocity);
+			simd::store(position, simd::add(simd::load(position), simd::mul(v, simd::set1(delta))));
+			simd::store(velocity, simd::sub(v, simd::mul(simd::sign(v), simd::set1(drag))));
+		}
+
+		simd::stepMixes(&colorMixes[i], &colorSpeeds[i], delta);
+	}
+#endif
+
+	for (; i < end; i++) {
+		ages[i] += agingRates[i]*delta;
+
+		particles[i][0] += velocities[i][0]*delta;
+		particles[i][1] += velocities[i][1]*delta;
+		particles[i][2] += velocities[i][2]*delta;
+
+		velocities[i][0] -= sgn(velocities[i][0])*drag;
+		velocities[i][1] -= sgn(velocities[i][1])*drag;
+		velocities[i][2] -= sgn(velocities[i][2])*drag;
+
+		colorMixes[i] = step(colorMixes[i], 1.0f, colorSpeeds[i]*delta);
+	}
+
+	resolveColors(begin, end);
+}
+
+// Water: gravity, bounces and pools on the ground
+void ParticleGroup::updateWater(int begin, int end, double dt) {
+	for (int i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		if (ages[i] > 2.0f*agingRates[i]) {
+			// Older than two seconds
+			colorMixes[i] = step(colorMixes[i], 1.0f, colorSpeeds[i]*dt);
+		}
+
+		if (!(flags[i] & PARTICLE_GROUNDED)) {
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][1] += velocities[i][1]*dt - dt*dt*GRAVITY/2.0;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (particles[i][1] < 0.1) {
+				particles[i][1] = 0.1;
+				velocities[i][1] *= -.4;
+				if (std::abs(velocities[i][1]*dt) < dt*dt*GRAVITY) {
+					velocities[i][1] = 0.0;
+					flags[i] |= PARTICLE_GROUNDED;
+				}
+			}
+			else {
+				velocities[i][1] -= GRAVITY*dt;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+		}
+		else {
+			if (velocities[i][0] == 0.0 && velocities[i][2] == 0.0) {
+				float size = unpackSize(sizes[i]);
+				if (size < WATERMINSIZE) {
+					dead[i] = true;
+					continue;
+				}
+				setSize(i, size - WATERSHRINK*dt);
+			}
+
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+			velocities[i][0] -= sgn(velocities[i][0])*2*dt;
+			velocities[i][2] -= sgn(velocities[i][2])*2*dt;
+
+			if (sqrt(velocities[i][0]*velocities[i][0] + velocities[i][2]*velocities[i][2]) < dt) {
+				velocities[i] = Vec3f(0.0, 0.0, 0.0);
+				flags[i] |= PARTICLE_ASLEEP;
+			}
+		}
+	}
+
+	resolveColors(begin, end);
+}
+
+// Fire: turbulent pull toward its emitter
+void ParticleGroup::updateFire(int begin, int end, double dt, const Vec3f &origin, uint64_t noiseKey) {
+	float xAcc, zAcc;
+
+	for (int i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		xAcc =  (origin[0] - particles[i][0])*randomFloat(2*(uint64_t)ids[i], noiseKey)/50;
+		xAcc += sgn(xAcc)*(particles[i][1] - origin[1])/2;
+		zAcc = (origin[2] - particles[i][2])*randomFloat(2*(uint64_t)ids[i] + 1, noiseKey)/50;
+		zAcc += sgn(zAcc)*(particles[i][1] - origin[1])/2;
+
+		particles[i][0] += velocities[i][0]*dt + xAcc*dt*dt/2;
+		particles[i][1] += velocities[i][1]*dt;
+		particles[i][2] += velocities[i][2]*dt + zAcc*dt*dt/2;
+
+		velocities[i][0] += xAcc*dt;
+		velocities[i][2] += zAcc*dt;
+
+		setSize(i, unpackSize(sizes[i]) - 25*dt);
+		colorMixes[i] = step(colorMixes[i], 1.0f, colorSpeeds[i]*dt);
+	}
+
+	resolveColors(begin, end);
+}
+
+// Smoke: weaker turbulence, slow fall and fade
+void ParticleGroup::updateSmoke(int begin, int end, double dt, const Vec3f &origin, uint64_t noiseKey) {
+	float xAcc, zAcc;
+	int i;
+
+	for (i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		xAcc =  (origin[0] - particles[i][0])*randomFloat(2*(uint64_t)ids[i], noiseKey)/50;
+		xAcc += sgn(xAcc)*(particles[i][1] - origin[1])/40;
+		zAcc = (origin[2] - particles[i][2])*randomFloat(2*(uint64_t)ids[i] + 1, noiseKey)/50;
+		zAcc += sgn(zAcc)*(particles[i][1] - origin[1])/40;
+
+		particles[i][0] += velocities[i][0]*dt + xAcc*dt*dt/2;
+		particles[i][1] += velocities[i][1]*dt - 9.8*dt*dt/2;
+		particles[i][2] += velocities[i][2]*dt + zAcc*dt*dt/2;
+
+		velocities[i][0] += xAcc*dt;
+		velocities[i][1] -= .1*dt;
+		velocities[i][2] += zAcc*dt;
+
+		colorMixes[i] = step(colorMixes[i], 1.0f, colorSpeeds[i]*dt);
+	}
+
+	resolveColors(begin, end);
+
+	// Smoke fades by a tenth of its alpha every second instead of mixing it
+	for (i = begin; i < end; i++) {
+		float lived = agingRates[i] > 0.0f ? ages[i]/agingRates[i] : 0.0f;
+		colors[i][3] = packUnorm8(unpackUnorm8(colorStarts[i][3]) - .1f*lived);
+	}
+}
+
+// Bubbles: drag, pop on the ground
+void ParticleGroup::updateBubble(int begin, int end, double dt) {
+	for (int i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		particles[i][0] += velocities[i][0]*dt;
+		particles[i][1] += velocities[i][1]*dt;
+		particles[i][2] += velocities[i][2]*dt;
+
+
+		if (abs(particles[i][0]) >= 100.0) {
+			particles[i][0] = sgn(particles[i][0])*99.9;
+			velocities[i][0] *= -.7;
+		}
+
+		if (particles[i][1] < 0.1) {
+			dead[i] = true;
+			continue;
+		}
+		else {
+			velocities[i][0] -= sgn(velocities[i][0])*.2*dt;
+			velocities[i][1] -= sgn(velocities[i][1])*.2*dt;
+			velocities[i][2] -= sgn(velocities[i][2])*.2*dt;
+		}
+
+		if (abs(particles[i][2] - 100.0) >= 100.0) {
+			particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+			velocities[i][2] *= -.7;
+		}
+	}
+}
+
+// Balls: gravity, bounce, shrink away once grounded
+void ParticleGroup::updateBall(int begin, int end, double dt) {
+	for (int i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		if (!(flags[i] & PARTICLE_GROUNDED)) {
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][1] += velocities[i][1]*dt - dt*dt*GRAVITY/2.0;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (particles[i][1] < 0.1) {
+				particles[i][1] = 0.1;
+				velocities[i][1] *= -.4;
+				if (std::abs(velocities[i][1]*dt) < dt*dt*GRAVITY) {
+					velocities[i][1] = 0.0;
+					flags[i] |= PARTICLE_GROUNDED;
+				}
+			}
+			else {
+				velocities[i][1] -= GRAVITY*dt;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+		}
+		else {
+			float size = unpackSize(sizes[i]);
+			if (size < BALLMINSIZE) {
+				dead[i] = true;
+				continue;
+			}
+			setSize(i, size - BALLSHRINK*dt);
+
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+			velocities[i][0] -= sgn(velocities[i][0])*2*dt;
+			velocities[i][2] -= sgn(velocities[i][2])*2*dt;
+
+			if (sqrt(velocities[i][0]*velocities[i][0] + velocities[i][2]*velocities[i][2]) < dt) {
+				velocities[i] = Vec3f(0.0, 0.0, 0.0);
+				flags[i] |= PARTICLE_ASLEEP;
+			}
+		}
+	}
+}
+
+// Bouncing balls that never expire
+void ParticleGroup::updateBounce(int begin, int end, double dt) {
+	for (int i = begin; i < end; i++) {
+		ages[i] += agingRates[i]*(float)dt;
+
+		if (!(flags[i] & PARTICLE_GROUNDED)) {
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][1] += velocities[i][1]*dt - dt*dt*GRAVITY/2.0;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (particles[i][1] < 0.1) {
+				particles[i][1] = 0.1;
+				velocities[i][1] *= -.3;
+				if (std::abs(velocities[i][1]*dt) < dt*dt*GRAVITY) {
+					velocities[i][1] = 0.0;
+					flags[i] |= PARTICLE_GROUNDED;
+				}
+			}
+			else {
+				velocities[i][1] -= GRAVITY*dt;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+		}
+		else {
+			particles[i][0] += velocities[i][0]*dt;
+			particles[i][2] += velocities[i][2]*dt;
+			if (abs(particles[i][0]) >= 100.0) {
+				particles[i][0] = sgn(particles[i][0])*99.9;
+				velocities[i][0] *= -.7;
+			}
+
+			if (abs(particles[i][2] - 100.0) >= 100.0) {
+				particles[i][2] = 100 + sgn(particles[i][2])*99.9;
+				velocities[i][2] *= -.7;
+			}
+			velocities[i][0] -= sgn(velocities[i][0])*2*dt;
+			velocities[i][2] -= sgn(velocities[i][2])*2*dt;
+
+			if (sqrt(velocities[i][0]*velocities[i][0] + velocities[i][2]*velocities[i][2]) < dt) {
+				velocities[i] = Vec3f(0.0, 0.0, 0.0);
+				flags[i] |= PARTICLE_ASLEEP;
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+
+ParticleSystem::ParticleSystem(long long maxParticles) : numParticles(0), maxParticles(maxParticles),
+	numSpawned(0), numKilled(0), numUpdated(0), frame(0), time(0), pool(new ThreadPool()), chunkSize(DEFAULTCHUNKSIZE), nextId(0), profiler(NULL),
+	spawnScale(1.0), limitReported(false), quiet(false) {
+	for (int force = 0; force < NUMFORCES; force++)
+		groups[force].force = force;
+	setSeed(RANDOMSEED);
+}
+
+ParticleSystem::~ParticleSystem() {
+	delete pool;
+}
+
+//----------------------------------------------------------------------------
+// function for choosing how update spreads its work
+void ParticleSystem::setThreads(int numThreads, int chunkSize) {
+	if (numThreads != pool->numThreads()) {
+		delete pool;
+		pool = new ThreadPool(numThreads);
+	}
+	this->chunkSize = chunkSize > 0 ? chunkSize : DEFAULTCHUNKSIZE;
+}
+
+void ParticleSystem::setRing(int force, bool ring) {
+	if (groups[force].numParticles == 0)
+		groups[force].ring = ring;
+}
+
+void ParticleSystem::setStateless(bool stateless) {
+	int forces[] = { FORCE_FIREWORK, FORCE_EXPLOSION };
+	for (int k = 0; k < 2; k++) {
+		ParticleGroup &group = groups[forces[k]];
+		if (stateless && !group.stateless)
+			grow(group.births, 0, group.capacity);
+		else if (!stateless) {
+			delete[] group.births;
+			group.births = NULL;
+		}
+		group.stateless = stateless;
+	}
+}
+
+void ParticleSystem::setInterpolated(bool interpolated) {
+	for (int force = 0; force < NUMFORCES; force++) {
+		ParticleGroup &group = groups[force];
+		if (interpolated && !group.interpolated) {
+			grow(group.previous, 0, group.capacity);
+			if (group.extent() > 0)
+				memcpy(group.previous, group.particles, group.extent()*sizeof(Vec3f));
+		}
+		else if (!interpolated) {
+			delete[] group.previous;
+			group.previous = NULL;
+		}
+		group.interpolated = interpolated;
+	}
+}
+
+// FNV-1a over the bytes of a value
+template<typename T>
+static void hashBytes(uint64_t &hash, const T &value) {
+	const unsigned char *bytes = (const unsigned char*)&value;
+	for (size_t k = 0; k < sizeof(T); k++)
+		hash = (hash ^ bytes[k])*1099511628211ULL;
+}
+
+uint64_t ParticleSystem::hash() const {
+	uint64_t hash = 14695981039346656037ULL;
+	for (int force = 0; force < NUMFORCES; force++) {
+		const ParticleGroup &group = groups[force];
+		int bounds[4];
+		int numRanges = group.ranges(bounds);
+		for (int range = 0; range < numRanges; range++) {
+			for (int i = bounds[2*range]; i < bounds[2*range + 1]; i++) {
+				hashBytes(hash, group.ids[i]);
+				hashBytes(hash, group.particles[i]);
+				hashBytes(hash, group.colors[i]);
+				hashBytes(hash, group.sizes[i]);
+				hashBytes(hash, (uint8_t)group.dead[i]);
+			}
+		}
+	}
+	return hash;
+}
+
+long long ParticleSystem::bytes() const {
+	long long total = 0;
+	for (int force = 0; force < NUMFORCES; force++)
+		total += groups[force].bytes();
+	return total;
+}
+
+void ParticleSystem::setProfiler(Profiler *profiler) {
+	this->profiler = profiler;
+}
+
+int ParticleSystem::numThreads() const {
+	return pool->numThreads();
+}
+
+//----------------------------------------------------------------------------
+// function for restarting the random numbers
+void ParticleSystem::setSeed(uint64_t seed) {
+	this->seed = seed;
+	threadRandom().start(randomKey(seed, STREAM_SCENE, frame));
+}
+
+//----------------------------------------------------------------------------
+// function for compiling an emitter into a spawn program
+SpawnProgram compileEmitter(const Emitter &emitter) {
+	SpawnProgram program;
+	const Particle &properties = emitter.properties;
+	int k;
+
+	if (emitter.shape.name == "disk")
+		program.shape = SHAPE_DISK;
+	else if (emitter.shape.name == "ring")
+		program.shape = SHAPE_RING;
+	else
+		program.shape = SHAPE_POINT;
+	program.radius = emitter.shape.sizeX;
+	program.radiusSpan = emitter.shape.sizeY - emitter.shape.sizeX;
+	program.symmetrical = emitter.shape.symmetrical;
+
+	for (k = 0; k < 3; k++) {
+		program.velocity[k] = properties.velocityRange[0][k];
+		program.velocitySpan[k] = properties.velocityRange[1][k] - properties.velocityRange[0][k];
+	}
+	for (k = 0; k < 4; k++) {
+		program.colorStart[k] = properties.colorStartRange[0][k];
+		program.colorStartSpan[k] = properties.colorStartRange[1][k] - properties.colorStartRange[0][k];
+		program.colorEnd[k] = properties.colorEndRange[0][k];
+		program.colorEndSpan[k] = properties.colorEndRange[1][k] - properties.colorEndRange[0][k];
+	}
+	program.colorSpeed = properties.colorSpeedRange[0];
+	program.colorSpeedSpan = properties.colorSpeedRange[1] - properties.colorSpeedRange[0];
+	program.lifetime = properties.lifetimeRange[0];
+	program.lifetimeSpan = properties.lifetimeRange[1] - properties.lifetimeRange[0];
+	program.size = properties.sizeRange[0];
+	program.sizeSpan = properties.sizeRange[1] - properties.sizeRange[0];
+	program.blur = properties.blurRange[0];
+	program.blurSpan = properties.blurRange[1] - properties.blurRange[0];
+	program.lighting = properties.lighting;
+
+	program.force = properties.force > 0 && properties.force < NUMFORCES ? properties.force : 0;
+	program.id = emitter.id;
+	program.genRate = emitter.genRate;
+	program.position = emitter.position;
+	return program;
+}
+
+// Calls store(i, start + span*u) for each of count particles, where u is the
+// given draw of particle i in the emitter's stream
+template<typename Store>
+static void spawnRange(int count, float start, float span, uint64_t key, int draw, Store store) {
+	for (int i = 0; i < count; i++)
+		store(i, start + span*randomFloat((uint64_t)(i + 1)*SPAWNDRAWS + draw, key));
+}
+
+//----------------------------------------------------------------------------
+// function for emitting new particles
+void ParticleSystem::spawnParticles(const SpawnProgram &program, double dt) {
+	int i, k;
+	int force = program.force;
+	if (force > 0)
+		origins[force] = program.position;
+
+	ProfileTimer timer(profiler, PHASE_SPAWN, frame);
+
+	// Counter 0 of the emitter's stream decides the count; particle i draws
+	// from counters (i + 1)*SPAWNDRAWS onwards
+	uint64_t key = randomKey(seed, STREAM_EMITTER, program.id, frame);
+
+	// Determine number to spawn
+	double numToSpawn = program.genRate * spawnScale * dt;
+	int count = (int)numToSpawn;
+	if (randomFloat(0, key) < numToSpawn - count)
+		count++;
+
+	// Only said the first time, not on every spawn from then on
+	if (count > room(force)) {
+		if (!limitReported && !quiet)
+			cout << "Particle limit reached!" << endl;
+		limitReported = true;
+		count = (int)room(force);
+	}
+	if (count <= 0)
+		return;
+
+	ParticleGroup &group = groups[force];
+	int first = add(force, count);
+	timer.setCount(count);
+
+	// Spawn location
+	Vec3f *particles = &group.particles[first];
+	const Vec3f &position = program.position;
+	if (program.shape == SHAPE_POINT) {
+		for (i = 0; i < count; i++)
+			particles[i] = position;
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			uint64_t draws = (uint64_t)(i + 1)*SPAWNDRAWS;
+			float radius = program.shape == SHAPE_DISK ?
+				program.radius*sqrt(randomFloat(draws + DRAW_RADIUS, key)) :
+				program.radius + program.radiusSpan*randomFloat(draws + DRAW_RADIUS, key);
+			float theta = 2*PI*randomFloat(draws + DRAW_ANGLE, key);
+			particles[i] = Vec3f(sin(theta)*radius + position[0],
+								 position[1],
+								 cos(theta)*radius + position[2]);
+		}
+	}
+
+	// Spawn velocity
+	Vec3f *velocities = &group.velocities[first];
+	if (program.symmetrical) {
+		for (i = 0; i < count; i++) {
+			uint64_t draws = (uint64_t)(i + 1)*SPAWNDRAWS;
+			float velocity = program.velocity[0] + program.velocitySpan[0]*randomFloat(draws + DRAW_SPEED, key);
+			float signX = randomFloat(draws + DRAW_SIGNX, key) < 0.5f ? -1.0f : 1.0f;
+			float signZ = randomFloat(draws + DRAW_SIGNZ, key) < 0.5f ? -1.0f : 1.0f;
+			float x = velocity*randomFloat(draws + DRAW_VELOCITY, key);
+			velocities[i] = Vec3f(signX*x,
+								  program.velocity[1] + program.velocitySpan[1]*randomFloat(draws + DRAW_VELOCITY + 1, key),
+								  signZ*sqrt(velocity*velocity - x*x));
+		}
+	}
+	else {
+		for (k = 0; k < 3; k++)
+			spawnRange(count, program.velocity[k], program.velocitySpan[k], key, DRAW_VELOCITY + k,
+				[velocities, k](int i, float value) { velocities[i][k] = value; });
+	}
+
+	// Spawn color and final color
+	uint8_t (*colorStarts)[4] = &group.colorStarts[first];
+	uint8_t (*colorChanges)[4] = &group.colorChanges[first];
+	for (k = 0; k < 4; k++) {
+		spawnRange(count, program.colorStart[k], program.colorStartSpan[k], key, DRAW_COLOR + k,
+			[colorStarts, k](int i, float value) { colorStarts[i][k] = packUnorm8(value); });
+		spawnRange(count, program.colorEnd[k], program.colorEndSpan[k], key, DRAW_COLOREND + k,
+			[colorChanges, k](int i, float value) { colorChanges[i][k] = packUnorm8(value); });
+	}
+	memcpy(&group.colors[first], colorStarts, count*sizeof(colorStarts[0]));
+
+	// Other particle properties
+	uint16_t *sizes = &group.sizes[first];
+	uint8_t *blurs = &group.blurs[first];
+	float *colorSpeeds = &group.colorSpeeds[first], *agingRates = &group.agingRates[first];
+	spawnRange(count, program.size, program.sizeSpan, key, DRAW_SIZE,
+		[sizes](int i, float value) { sizes[i] = packSize(value); });
+	spawnRange(count, program.blur, program.blurSpan, key, DRAW_BLUR,
+		[blurs](int i, float value) { blurs[i] = packUnorm8(value); });
+	spawnRange(count, program.colorSpeed, program.colorSpeedSpan, key, DRAW_COLORSPEED,
+		[colorSpeeds](int i, float value) { colorSpeeds[i] = value; });
+	spawnRange(count, program.lifetime, program.lifetimeSpan, key, DRAW_LIFETIME,
+		[agingRates](int i, float value) { agingRates[i] = 1.0f/value; });
+	memset(&group.lightings[first], packUnorm8(program.lighting), count*sizeof(uint8_t));
+	group.schedule(first, count, time);
+
+	numSpawned += count;
+}
+
+//----------------------------------------------------------------------------
+// function for finding how many particles a force's group can still take
+long long ParticleSystem::room(int force) const {
+	long long room = INT_MAX - groups[force].numParticles;
+	if (maxParticles > 0)
+		room = std::min(room, maxParticles - numParticles);
+	return std::max(room, 0LL);
+}
+
+//----------------------------------------------------------------------------
+// function for adding particles to a force's group
+int ParticleSystem::add(int force, int count) {
+	if (count > room(force))
+		return -1;
+
+	numParticles += count;
+	ParticleGroup &group = groups[force];
+	int first = group.add(count);
+	for (int i = first; i < first + count; i++)
+		group.ids[i] = nextId++;
+	if (group.births) {
+		for (int i = first; i < first + count; i++)
+			group.births[i] = (float)time;
+	}
+	return first;
+}
+
+//----------------------------------------------------------------------------
+// function for advancing every particle by one time step
+void ParticleSystem::update(double dt) {
+	int force;
+
+	// Each group is stepped by its own force's loop. Particles only touch their
+	// own slots while stepping, so chunks of a group can be stepped on any
+	// thread; the ones that die are only marked, and are removed afterwards.
+	uint64_t noiseKey = randomKey(seed, STREAM_NOISE, frame);
+	Profiler *chunkProfiler = detailed(profiler);
+	for (force = 0; force < NUMFORCES; force++) {
+		ParticleGroup &group = groups[force];
+		ProfileTimer timer(profiler, PHASE_UPDATE + force, frame, group.numParticles);
+		int bounds[4];
+		int numRanges = group.awakeRanges(bounds);
+		for (int range = 0; range < numRanges; range++)
+			numUpdated += bounds[2*range + 1] - bounds[2*range];
+
+		group.expire(time + dt);
+		if (group.stateless)
+			continue;
+
+		for (int range = 0; range < numRanges; range++) {
+			int offset = bounds[2*range];
+			pool->parallelFor(bounds[2*range + 1] - offset, chunkSize, [this, &group, offset, dt, noiseKey, chunkProfiler, force](int begin, int end) {
+				ProfileTimer timer(chunkProfiler, PHASE_KERNEL + force, frame, end - begin);
+				group.update(offset + begin, offset + end, dt, origins, noiseKey);
+			});
+		}
+		// The kernels mark the awake particles they resize. The sleepers of
+		// groups that shrink them (the ones with settle times) are sized from
+		// the time, and every step takes them down by many packed steps, so
+		// each one is marked.
+		if (group.settled)
+			memset(group.moved, 1, group.numAsleep*sizeof(bool));
+	}
+
+	ProfileTimer timer(profiler, PHASE_COMPACT, frame, numParticles);
+	for (force = 0; force < NUMFORCES; force++) {
+		int numDead = groups[force].compact(*pool, chunkSize);
+		numParticles -= numDead;
+		numKilled += numDead;
+		groups[force].fallAsleep(*pool, chunkSize, time + dt);
+	}
+
+	// The scene draws from a new stream every frame
+	frame++;
+	time += dt;
+	threadRandom().start(randomKey(seed, STREAM_SCENE, frame));
+}
+
+//----------------------------------------------------------------------------
+// functions for packing a group's render vertices
+void ParticleSystem::packDynamic(int force, DynamicVertex *vertices, float blend) {
+	const ParticleGroup &group = groups[force];
+	int bounds[4];
+	int numRanges = group.ranges(bounds);
+	for (int range = 0; range < numRanges; range++) {
+		int offset = bounds[2*range];
+		double time = this->time;
+		pool->parallelFor(bounds[2*range + 1] - offset, chunkSize, [&group, offset, vertices, blend, time](int begin, int end) {
+			group.packDynamic(offset + begin, offset + end, vertices + offset + begin, blend, time);
+		});
+	}
+}
+
+// Packs the vertices of a group's particles that changed since the last call
+// with pack(begin, end, vertices + begin): the moved ones before staticFrom,
+// found chunk by chunk in parallel, and every one from staticFrom on
+template<typename Vertex, typename Pack>
+static void packChanged(ParticleGroup &group, ThreadPool &pool, int chunkSize, Vertex *vertices, std::vector<int> &runs, Pack pack) {
+	int numParticles = group.extent();
+	int tail = std::min(group.staticFrom, numParticles);
+	int numChunks = (tail + chunkSize - 1)/chunkSize;
+	std::vector< std::vector<int> > chunkRuns(numChunks);
+
+	pool.parallelFor(tail, chunkSize, [&group, &chunkRuns, vertices, chunkSize, &pack](int begin, int end) {
+		std::vector<int> &found = chunkRuns[begin/chunkSize];
+		for (int i = begin; i < end; i++) {
+			if (!group.moved[i])
+				continue;
+			group.moved[i] = false;
+			if (!found.empty() && found.back() == i)
+				found.back() = i + 1;
+			else {
+				found.push_back(i);
+				found.push_back(i + 1);
+			}
+		}
+		for (size_t run = 0; run < found.size(); run += 2)
+			pack(found[run], found[run + 1], vertices + found[run]);
+	});
+	for (int chunk = 0; chunk < numChunks; chunk++)
+		runs.insert(runs.end(), chunkRuns[chunk].begin(), chunkRuns[chunk].end());
+
+	if (tail < numParticles) {
+		pool.parallelFor(numParticles - tail, chunkSize, [&group, vertices, tail, &pack](int begin, int end) {
+			memset(&group.moved[tail + begin], 0, (end - begin)*sizeof(bool));
+			pack(tail + begin, tail + end, vertices + tail + begin);
+		});
+		runs.push_back(tail);
+		runs.push_back(numParticles);
+	}
+	group.staticFrom = numParticles;
+}
+
+void ParticleSystem::packStatic(int force, StaticVertex *vertices, std::vector<int> &runs) {
+	const ParticleGroup &group = groups[force];
+	double time = this->time;
+	packChanged(groups[force], *pool, chunkSize, vertices, runs, [&group, time](int begin, int end, StaticVertex *out) {
+		group.packStatic(begin, end, out, time);
+	});
+}
+
+void ParticleSystem::packSpawns(int force, SpawnVertex *vertices, std::vector<int> &runs) {
+	const ParticleGroup &group = groups[force];
+	packChanged(groups[force], *pool, chunkSize, vertices, runs, [&group](int begin, int end, SpawnVertex *out) {
+		group.packSpawns(begin, end, out);
+	});
+}
@@ -0,0 +1,449 @@
+// Particle simulation core: particle state, emitters and the per-frame update.
+// Nothing in here touches GLFW or OpenGL, so the same code drives the demo
+// viewers and any headless tools built on top of the particle_core library.
+
+#ifndef PARTICLE_SYSTEM_HPP
+#define PARTICLE_SYSTEM_HPP 1
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// This file contains the vector type and the random/step helpers
+#include "helper.hpp"
+// This file contains the conversions to the compact attribute formats
+#include "pack.hpp"
+// This file contains the expiry queue of the groups whose particles age out
+#include "timing_wheel.hpp"
+
+#define MAXSIZE 100
+
+// Particles stepped per task when update is spread across threads
+#define DEFAULTCHUNKSIZE 4096
+
+#define GRAVITY 9.8
+
+// Bits of ParticleGroup::flags
+enum {
+	PARTICLE_GROUNDED = 1,	// resting on the ground
+	PARTICLE_PADDING = 2,	// not a particle: a ring slot skipped to keep a batch contiguous
+	PARTICLE_ASLEEP = 4		// settled on the ground and no longer stepped, see ParticleGroup::sleeps
+};
+
+// Sizes are stored as 16-bit fractions of MAXSIZE
+inline uint16_t packSize(float size) { return packUnorm16(size/MAXSIZE); }
+inline float unpackSize(uint16_t size) { return unpackUnorm16(size)*MAXSIZE; }
+
+// Behaviors a particle can follow, selected with Particle::force
+enum {
+	FORCE_FIREWORK = 1,	// firework trails: gravity, shrink over life
+	FORCE_EXPLOSION,	// explosion sparks: linear drag
+	FORCE_WATER,		// water: gravity, bounces and pools on the ground
+	FORCE_FIRE,			// fire: turbulent pull toward its emitter
+	FORCE_SMOKE,		// smoke: weaker turbulence, slow fall and fade
+	FORCE_BUBBLE,		// bubbles: drag, pop on the ground
+	FORCE_BALL,			// balls: gravity, bounce, shrink away once grounded
+	FORCE_BOUNCE,		// bouncing balls that never expire
+	NUMFORCES
+};
+
+//----------------------------------------------------------------------------
+
+typedef struct {
+	float colorStartRange[2][4];
+	float colorEndRange[2][4];
+	float colorSpeedRange[2];
+	float lifetimeRange[2];
+	float sizeRange[2];
+	float blurRange[2];
+	Vec3f velocityRange[2];
+	float lighting;
+	int force;
+} Particle;
+
+typedef struct {
+	std::string name;
+	double sizeX;
+	double sizeY;
+	double sizeZ;
+	bool symmetrical;
+} Shape;
+
+typedef struct {
+	Shape shape;
+	Particle properties;
+	double genRate;
+	Vec3f position;
+	Vec3f velocity;
+	Vec3f direction;
+	int id;			// tells apart the random streams of emitters spawning in the same frame
+} Emitter;
+
+// Emitter shapes, from Shape::name
+enum {
+	SHAPE_POINT,	// any name but "disk" or "ring"
+	SHAPE_DISK,		// uniform over a disk of radius sizeX
+	SHAPE_RING,		// uniform radius between sizeX and sizeY
+};
+
+// An emitter compiled for spawning: the shape name becomes an enum and every
+// range a start and a span (end - start). Scenes compile their emitters once
+// and only move position around afterwards.
+typedef struct {
+	int shape;
+	float radius;
+	float radiusSpan;
+	bool symmetrical;
+
+	float velocity[3];
+	float velocitySpan[3];
+	float colorStart[4];
+	float colorStartSpan[4];
+	float colorEnd[4];
+	float colorEndSpan[4];
+	float colorSpeed;
+	float colorSpeedSpan;
+	float lifetime;
+	float lifetimeSpan;
+	float size;
+	float sizeSpan;
+	float blur;
+	float blurSpan;
+	float lighting;
+
+	int force;		// 0 when the emitter's force is out of range
+	int id;
+	double genRate;
+	Vec3f position;
+} SpawnProgram;
+
+SpawnProgram compileEmitter(const Emitter &emitter);
+
+//----------------------------------------------------------------------------
+
+// What the renderer draws for a particle, split by how often it changes.
+// Positions and colors change every step and are uploaded every frame.
+typedef struct {
+	Vec3f position;
+	uint8_t color[4];	// RGBA8
+} DynamicVertex;
+
+// Blurs and lightings are set at spawn and sizes change only under some
+// forces, so these stay on the GPU until a particle spawns into or moves to
+// a slot (see ParticleSystem::packStatic)
+typedef struct {
+	uint16_t size;		// see packSize
+	uint8_t blur;		// normalized 8-bit
+	uint8_t lighting;	// normalized 8-bit
+} StaticVertex;
+
+// Everything the vertex shader needs to place and color a particle of a
+// stateless group (see ParticleSystem::setStateless) at any time, uploaded
+// once like a static vertex
+typedef struct {
+	Vec3f position;			// at spawn
+	uint8_t colorStart[4];	// RGBA8
+	uint16_t size;
+	uint8_t blur;
+	uint8_t lighting;
+	Vec3f velocity;			// at spawn
+	uint8_t colorEnd[4];	// RGBA8
+	float birth;			// ParticleSystem::time at spawn
+	float agingRate;
+	float colorSpeed;
+} SpawnVertex;
+
+//----------------------------------------------------------------------------
+
+class ThreadPool;
+class Profiler;
+
+// The particles that follow one force, stored contiguously so that every
+// force is stepped by its own loop with no per-particle dispatch
+class ParticleGroup {
+public:
+	ParticleGroup();
+	~ParticleGroup();
+
+	// Appends count particles, growing the arrays geometrically as needed,
+	// and returns the index of the first. Ages, aging rates, color mixes and flags start at
+	// 0, so the particles never expire; the caller fills in the rest. A batch
+	// always takes consecutive indices, in rings too.
+	int add(int count = 1);
+
+	// Marks a particle dead; it is removed at the end of the next update
+	void kill(int index) { dead[index] = true; }
+
+	// Queues the particles in [first, first + count) to expire once their
+	// lifetimes (1/agingRates) have passed from time, if the group's force
+	// ages particles out. Call it once their aging rates are set.
+	void schedule(int first, int count, double time);
+
+	// Marks dead the queued particles whose lifetimes end before time. Only
+	// those particles are touched.
+	void expire(double time);
+
+	// Steps the particles in [begin, end) by dt seconds, marking the ones that
+	// die other than by age. Turbulence is drawn from noiseKey's stream at the
+	// particles' ids.
+	void update(int begin, int end, double dt, const Vec3f origins[NUMFORCES], uint64_t noiseKey);
+
+	// Removes every particle marked dead and returns how many there were.
+	// Rings only retire the dead at their oldest end and return how many
+	// particles that was; the rest stay in place, marked, until they get there.
+	int compact(ThreadPool &pool, int chunkSize);
+
+	// Moves the particles that settled during the last step to the sleeping
+	// ones, which fell asleep at time
+	void fallAsleep(ThreadPool &pool, int chunkSize, double time);
+
+	// Splits the slots in use into at most two [begin, end) ranges of indices,
+	// oldest first, and returns how many there are. Rings wrap around the end
+	// of the arrays; other groups take [0, numParticles).
+	int ranges(int bounds[4]) const;
+
+	// The same for the particles update steps, which leaves out the sleeping
+	int awakeRanges(int bounds[4]) const;
+
+	// Indices the particles can be at: numParticles, or capacity for rings
+	int extent() const { return ring ? capacity : numParticles; }
+
+	// Packs the dynamic or static render vertices of the particles in
+	// [begin, end) into vertices. Dead particles still in a ring get a
+	// transparent color, which the renderer never draws, and sleeping ones
+	// the size they have shrunk to and the color they have mixed to by time.
+	// Interpolated groups are placed blend of the way from their previous
+	// positions to their current ones.
+	void packDynamic(int begin, int end, DynamicVertex *vertices, float blend, double time) const;
+	void packStatic(int begin, int end, StaticVertex *vertices, double time) const;
+	void packSpawns(int begin, int end, SpawnVertex *vertices) const;
+
+	// Whether the group's particles die once their lifetimes end (balls and
+	// particles without a force outlive them)
+	bool expires() const;
+
+	// Whether the group's particles fall asleep once they come to rest on
+	// the ground (water and balls). Nothing about a sleeping particle changes
+	// but its size, which shrinks at a constant rate until it dies, and the
+	// color of water, which keeps mixing toward its end color, so update
+	// leaves the sleeping particles out: they are kept before the awake ones,
+	// their sizes and colors are worked out when they are packed,
+	// and their deaths are queued with the expiring particles.
+	bool sleeps() const;
+
+	// Notes that the static render attributes of the particles from index
+	// on have changed. add and compact note their own changes (compact marks
+	// the slots it moves particles into); code that sets sizes, blurs or
+	// lightings of existing particles must call it, or mark them in moved.
+	void touchStatic(int index) { staticFrom = std::min(staticFrom, index); }
+
+	// Sets a particle's size, marking it to be packed again only if its
+	// packed size changed
+	void setSize(int index, float size) {
+		uint16_t packed = packSize(size);
+		if (packed != sizes[index]) {
+			sizes[index] = packed;
+			moved[index] = true;
+		}
+	}
+
+	// Bytes every slot takes over the arrays below the group allocates, and
+	// over all its slots with the expiry queue's entries
+	int bytesPerParticle() const;
+	long long bytes() const;
+
+	int force;			// shared by the whole group, so particles do not store it
+	int numParticles;
+	int numAsleep;		// particles in [0, numAsleep) are asleep, the rest awake (rings don't sleep)
+	int capacity;
+	int staticFrom;		// first particle whose static vertex changed since it was last packed
+	bool stateless;		// only expired by update; the renderer evaluates the rest from spawn state
+	bool ring;			// particles are added at the newest end and retired from the oldest, see setRing
+	bool interpolated;	// update keeps the positions from before the step, see setInterpolated
+	int first;			// index of a ring's oldest slot in use, 0 for other groups
+
+	// Particle info that is uploaded for rendering
+	Vec3f *particles;
+	uint8_t (*colors)[4];		// RGBA8, resolved from the start and end colors every step
+	uint8_t *lightings;			// normalized 8-bit
+	uint16_t *sizes;			// see packSize
+	uint8_t *blurs;				// normalized 8-bit
+
+	// Particle info that only the simulation uses
+	Vec3f *velocities;
+	uint8_t (*colorStarts)[4];	// RGBA8
+	uint8_t (*colorChanges)[4];	// RGBA8 end colors
+	float *colorMixes;			// how far colors are from their start to their end color
+	float *colorSpeeds;
+	float *ages;				// fraction of the lifetime lived; the particle expires past 1 (see schedule)
+	float *agingRates;			// 1/lifetime in seconds, 0 for particles that never expire
+	uint8_t *flags;				// PARTICLE_ bits
+	bool *dead;					// marked while stepping, removed by compact at the end of update.
+								// Kept apart from flags: compact reads the marks while it moves flags.
+	unsigned *ids;				// order the particles were added in, which keys their random numbers
+	bool *moved;				// moved into by compact, or resized, since the static vertex was last packed
+
+	// Particle info only some groups need, NULL in the rest
+	float *births;				// ParticleSystem::time the particles were added at, for stateless groups
+	WheelHandle *expiries;		// where the particles are queued in expiry, for groups that queue deaths
+	float *settled;				// ParticleSystem::time a sleeping particle fell asleep at, for groups that shrink asleep
+	Vec3f *previous;			// positions before the last step, only allocated for interpolated groups
+
+private:
+	TimingWheel expiry;			// particles by the time their lifetimes end, see schedule
+
+	void reserve(int capacity);
+	void clear(int begin, int end);
+	int compactRange(ThreadPool &pool, int chunkSize, int begin, int end);
+	void swap(int a, int b);
+	void settle(int index, double time);
+	float shrinkRate() const;
+	bool queuesDeaths() const;
+	float sleepingSize(int index, double time) const;
+	float sleepingMix(int index, double time) const;
+	int addToRing(int count);
+	int retire(ThreadPool &pool, int chunkSize);
+	void move(int from, int to);
+	void resolveColors(int begin, int end);
+
+	void updateFirework(int begin, int end, double dt);
+	void updateExplosion(int begin, int end, double dt);
+	void updateWater(int begin, int end, double dt);
+	void updateFire(int begin, int end, double dt, const Vec3f &origin, uint64_t noiseKey);
+	void updateSmoke(int begin, int end, double dt, const Vec3f &origin, uint64_t noiseKey);
+	void updateBubble(int begin, int end, double dt);
+	void updateBall(int begin, int end, double dt);
+	void updateBounce(int begin, int end, double dt);
+
+	ParticleGroup(const ParticleGroup&);
+	ParticleGroup &operator=(const ParticleGroup&);
+};
+
+//----------------------------------------------------------------------------
+
+class ParticleSystem {
+public:
+	// Groups grow as particles are added; maxParticles caps the total, with
+	// 0 for no cap
+	ParticleSystem(long long maxParticles = 0);
+	~ParticleSystem();
+
+	// Emits new particles from the emitter for a step of dt seconds, filling
+	// each attribute of the whole batch in turn. Each emitter draws from its
+	// own stream every frame, and each of its particles from its own block of
+	// that stream.
+	void spawnParticles(const SpawnProgram &program, double dt);
+
+	// Adds count particles to the group of the given force and returns the
+	// index of the first there, or -1 if they don't fit under maxParticles
+	int add(int force, int count = 1);
+
+	// How many more particles the group of the given force can take
+	long long room(int force) const;
+
+	// Advances every particle by dt seconds, killing the ones that expire
+	void update(double dt);
+
+	// Packs the dynamic render vertices of the force's group into vertices,
+	// which must hold all of its particles. With interpolation on, particles
+	// are placed blend (0 to 1) of the way through the last step.
+	void packDynamic(int force, DynamicVertex *vertices, float blend = 1.0f);
+
+	// Packs the static render vertices of the force's group that changed since
+	// the last call into vertices, each at its particle's index, and appends
+	// the runs of changed particles to runs as [begin, end) pairs. Passed the
+	// same vertices every time, they mirror the whole group's static vertices.
+	void packStatic(int force, StaticVertex *vertices, std::vector<int> &runs);
+
+	// Packs the spawn vertices of a stateless group the same way
+	void packSpawns(int force, SpawnVertex *vertices, std::vector<int> &runs);
+
+	// Makes the group of the given force a ring: particles are added after
+	// the newest and retired once every older one is dead, so they never
+	// move and stay in spawn order, and the group draws as at most two
+	// ranges. Dead particles wait for the older ones before their slots are
+	// reused, so it suits forces whose particles die roughly in spawn order,
+	// like fire and explosion sparks. Only takes effect on an empty group.
+	void setRing(int force, bool ring);
+
+	// Makes the groups whose motion, colors and sizes are closed-form
+	// functions of their spawn state and time (firework trails and explosion
+	// sparks) stateless: update only kills the ones that expire, and the
+	// renderer evaluates them from their spawn vertices. Their positions,
+	// colors and ages are left as spawned, so call it before spawning.
+	void setStateless(bool stateless);
+
+	// Makes update keep every particle's position from before the step, so
+	// a renderer running at its own rate can draw the particles between the
+	// last two steps (see packDynamic). The particles there already start
+	// out as if they hadn't moved. Costs another array of positions and a
+	// copy of them per step, so it is off unless asked for; turning it off
+	// frees the array.
+	void setInterpolated(bool interpolated);
+
+	// Bytes the groups' particle arrays and expiry queues take
+	long long bytes() const;
+
+	// Hash of every slot in use: its particle's id, position, color, size and
+	// dead mark, group by group in index order. The same seed gives the same
+	// hash whatever the thread count and chunk size.
+	uint64_t hash() const;
+
+	// Multiplies every emitter's rate, to load the system with more particles
+	// than the scenes spawn (see particle_bench)
+	void setSpawnScale(double scale) { spawnScale = scale; }
+
+	// Keeps spawnParticles from saying when the particle limit is reached,
+	// for runs that reach it on purpose (see particle_bench)
+	void setQuiet(bool quiet) { this->quiet = quiet; }
+
+	// Steps particles on numThreads threads (0 for one per hardware thread) in
+	// chunks of chunkSize particles. One thread steps them in order.
+	void setThreads(int numThreads, int chunkSize = DEFAULTCHUNKSIZE);
+	int numThreads() const;
+
+	// Times spawning, each force's update and compaction with the profiler
+	// (see profiler.hpp), or nothing with NULL. The profiler must outlive
+	// the system, or be replaced first.
+	void setProfiler(Profiler *profiler);
+
+	// Restarts the random numbers from a seed. The calling thread's stream
+	// (what scenes draw from with random() and range()) is restarted too, and
+	// update moves it on to a fresh stream every frame, so the same seed
+	// replays a run exactly whatever the thread count.
+	void setSeed(uint64_t seed);
+
+	long long numParticles;	// total over all groups
+	long long maxParticles;	// 0 for no cap
+
+	// groups[f] holds the particles following force f; group 0 only ages
+	ParticleGroup groups[NUMFORCES];
+
+	// Running totals of particles spawned, killed and stepped by update
+	// (sleeping particles aren't stepped, so they don't count as updated)
+	long long numSpawned;
+	long long numKilled;
+	long long numUpdated;
+
+	// Position of the last emitter that spawned each force (fire and smoke are pulled toward it)
+	Vec3f origins[NUMFORCES];
+
+	uint64_t seed;
+	long long frame;	// number of updates so far
+	double time;		// seconds simulated so far
+
+private:
+	ThreadPool *pool;
+	int chunkSize;
+	unsigned nextId;
+	Profiler *profiler;
+	double spawnScale;
+	bool limitReported;	// "Particle limit reached!" has been printed
+	bool quiet;			// never print it
+
+	ParticleSystem(const ParticleSystem&);
+	ParticleSystem &operator=(const ParticleSystem&);
+};
+
+#endif
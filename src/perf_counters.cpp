@@ -0,0 +1,121 @@
+// Hardware performance counters through perf_event_open
+
+#include <string.h>
+
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// The calling thread's counters, opened as one group led by the first that
+// opens, so they are all scheduled and read together
+struct ThreadCounters {
+	int fds[NUMCOUNTERS];	// -1 for counters that didn't open
+	int slots[NUMCOUNTERS];	// where each counter comes in a group read, -1 for none
+	int numOpen;
+	int leader;
+
+	ThreadCounters() : numOpen(0), leader(-1) {
+		static const uint32_t types[NUMCOUNTERS] = {
+			PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+		};
+		static const uint64_t configs[NUMCOUNTERS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for (int counter = 0; counter < NUMCOUNTERS; counter++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[counter];
+			attr.config = configs[counter];
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.disabled = leader < 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			// This thread, on any CPU
+			fds[counter] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader < 0 ? -1 : fds[leader], 0);
+			slots[counter] = fds[counter] >= 0 ? numOpen++ : -1;
+			if (fds[counter] >= 0 && leader < 0)
+				leader = counter;
+		}
+
+		if (leader >= 0) {
+			ioctl(fds[leader], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fds[leader], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+
+	~ThreadCounters() {
+		for (int counter = 0; counter < NUMCOUNTERS; counter++)
+			if (fds[counter] >= 0)
+				close(fds[counter]);
+	}
+
+	bool read(uint64_t values[NUMCOUNTERS]) {
+		// A group read gives the number of counters, the nanoseconds the
+		// group was enabled and running, then each count. When more events
+		// are open than the PMU has counters the kernel takes turns between
+		// groups, and the counts only cover the time the group ran, so they
+		// are scaled up to the time it was enabled. A group that never ran
+		// has nothing to scale.
+		uint64_t buffer[3 + NUMCOUNTERS];
+		if (leader < 0 || ::read(fds[leader], buffer, sizeof(buffer)) < (ssize_t)((3 + numOpen)*sizeof(uint64_t)) || buffer[2] == 0) {
+			memset(values, 0, NUMCOUNTERS*sizeof(uint64_t));
+			return false;
+		}
+		double scale = buffer[2] < buffer[1] ? (double)buffer[1]/buffer[2] : 1.0;
+		for (int counter = 0; counter < NUMCOUNTERS; counter++)
+			values[counter] = slots[counter] >= 0 ? (uint64_t)(buffer[3 + slots[counter]]*scale + 0.5) : 0;
+		return true;
+	}
+};
+
+ThreadCounters &threadCounters() {
+	static thread_local ThreadCounters counters;
+	return counters;
+}
+
+}
+
+bool readCounters(uint64_t values[NUMCOUNTERS]) {
+	return threadCounters().read(values);
+}
+
+bool counterAvailable(int counter) {
+	return threadCounters().fds[counter] >= 0;
+}
+
+#else
+
+bool readCounters(uint64_t values[NUMCOUNTERS]) {
+	memset(values, 0, NUMCOUNTERS*sizeof(uint64_t));
+	return false;
+}
+
+bool counterAvailable(int) {
+	return false;
+}
+
+#endif
+
+const char *counterName(int counter) {
+	switch (counter) {
+	case COUNTER_CYCLES:		return "cycles";
+	case COUNTER_INSTRUCTIONS:	return "instructions";
+	case COUNTER_L1MISSES:		return "L1 misses";
+	case COUNTER_LLCMISSES:		return "LLC misses";
+	case COUNTER_BRANCHMISSES:	return "branch misses";
+	default:					return "unknown";
+	}
+}
@@ -0,0 +1,31 @@
+// Hardware performance counters of the calling thread, through Linux's
+// perf_event_open. Each thread opens its own counters the first time it reads
+// them, counting only its own user-space work; elsewhere nothing can be
+// counted and every read fails.
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP 1
+
+#include <stdint.h>
+
+enum {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_L1MISSES,		// level 1 data cache read misses
+	COUNTER_LLCMISSES,		// last level cache misses
+	COUNTER_BRANCHMISSES,
+	NUMCOUNTERS
+};
+
+// Reads the calling thread's running counts into values, scaled up for the
+// time the kernel had them switched out. Counters this machine doesn't have
+// read as 0. Returns false, with every value 0, if none can be counted or
+// they haven't run yet.
+bool readCounters(uint64_t values[NUMCOUNTERS]);
+
+// Whether a counter could be opened on the calling thread
+bool counterAvailable(int counter);
+
+const char *counterName(int counter);
+
+#endif
@@ -0,0 +1,350 @@
+// Frame-phase profiler: lock-free sample ring, per-frame totals and reports
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include "profiler.hpp"
+
+//----------------------------------------------------------------------------
+
+Profiler::Profiler(double hitchMilliseconds) : ring(new Slot[PROFILERCAPACITY]), head(0), tail(0), dropped(0),
+	hitchMilliseconds(hitchMilliseconds), keepSamples(false), countCounters(false) {
+	for (uint64_t i = 0; i < PROFILERCAPACITY; i++)
+		ring[i].sequence.store(i, std::memory_order_relaxed);
+	for (int counter = 0; counter < NUMCOUNTERS; counter++)
+		available[counter] = false;
+	for (int phase = 0; phase < NUMPHASES; phase++) {
+		openFrame[phase] = -1;
+		openTotal[phase] = 0.0;
+		particleTotals[phase] = 0.0;
+		for (int counter = 0; counter < NUMCOUNTERS; counter++)
+			counterTotals[phase][counter] = 0.0;
+	}
+}
+
+Profiler::~Profiler() {
+	delete[] ring;
+}
+
+int64_t Profiler::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int Profiler::threadId() {
+	static std::atomic<int> numThreads(0);
+	static thread_local int id = numThreads.fetch_add(1);
+	return id;
+}
+
+const char *Profiler::phaseName(int phase) {
+	static const char *forceNames[NUMFORCES] = {
+		"update none", "update firework", "update explosion", "update water",
+		"update fire", "update smoke", "update bubble", "update ball", "update bounce"
+	};
+	static const char *kernelNames[NUMFORCES] = {
+		"kernel none", "kernel firework", "kernel explosion", "kernel water",
+		"kernel fire", "kernel smoke", "kernel bubble", "kernel ball", "kernel bounce"
+	};
+	if (phase >= PHASE_UPDATE && phase < PHASE_UPDATE + NUMFORCES)
+		return forceNames[phase - PHASE_UPDATE];
+	if (phase >= PHASE_KERNEL && phase < PHASE_KERNEL + NUMFORCES)
+		return kernelNames[phase - PHASE_KERNEL];
+
+	switch (phase) {
+	case PHASE_FRAME:	return "frame";
+	case PHASE_SPAWN:	return "spawn";
+	case PHASE_COMPACT:	return "compact";
+	case PHASE_PACK:	return "pack";
+	case PHASE_UPLOAD:	return "upload";
+	case PHASE_DRAW:	return "draw";
+	case PHASE_SWAP:	return "swap";
+	case PHASE_DRAWCALL:	return "draw call";
+	default:			return "unknown";
+	}
+}
+
+//----------------------------------------------------------------------------
+// functions for passing samples through the ring. A writer claims a position
+// by moving head past it, once the slot there has been read; the reader takes
+// slots in order as their writers finish.
+bool Profiler::record(const ProfileSample &sample) {
+	uint64_t position = head.load(std::memory_order_relaxed);
+	Slot *slot;
+	for (;;) {
+		slot = &ring[position & (PROFILERCAPACITY - 1)];
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		if (sequence == position) {
+			if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (sequence < position) {
+			// Still holds a sample from a lap ago that hasn't been collected
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+			position = head.load(std::memory_order_relaxed);
+	}
+
+	slot->sample = sample;
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+void Profiler::collect() {
+	for (;;) {
+		Slot &slot = ring[tail & (PROFILERCAPACITY - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+			break;
+		ProfileSample sample = slot.sample;
+		slot.sequence.store(tail + PROFILERCAPACITY, std::memory_order_release);
+		tail++;
+		add(sample);
+		if (keepSamples)
+			samples.push_back(sample);
+	}
+}
+
+void Profiler::finish() {
+	collect();
+	for (int phase = 0; phase < NUMPHASES; phase++)
+		close(phase);
+}
+
+// Adds a sample to its phase's total for its frame. A phase's samples come
+// from one thread in order, so a new frame means the last one is done.
+void Profiler::add(const ProfileSample &sample) {
+	int phase = sample.phase;
+	if (phase < 0 || phase >= NUMPHASES)
+		return;
+	if (sample.frame != openFrame[phase]) {
+		close(phase);
+		openFrame[phase] = sample.frame;
+	}
+	openTotal[phase] += (sample.end - sample.begin)*1e-6;
+
+	if (countCounters && sample.counted) {
+		particleTotals[phase] += sample.count;
+		for (int counter = 0; counter < NUMCOUNTERS; counter++)
+			counterTotals[phase][counter] += sample.counters[counter];
+	}
+}
+
+void Profiler::close(int phase) {
+	if (openFrame[phase] < 0)
+		return;
+
+	totals[phase].push_back((float)openTotal[phase]);
+	if (phase == PHASE_FRAME && openTotal[phase] > hitchMilliseconds) {
+		Hitch hitch;
+		hitch.frame = openFrame[phase];
+		hitch.milliseconds = openTotal[phase];
+		hitchList.push_back(hitch);
+	}
+
+	openFrame[phase] = -1;
+	openTotal[phase] = 0.0;
+}
+
+//----------------------------------------------------------------------------
+
+bool Profiler::setCounting(bool counting) {
+	uint64_t values[NUMCOUNTERS];
+	countCounters = counting && readCounters(values);
+	for (int counter = 0; counter < NUMCOUNTERS; counter++)
+		available[counter] = countCounters && counterAvailable(counter);
+	return countCounters == counting;
+}
+
+double Profiler::perParticle(int phase, int counter) const {
+	return particleTotals[phase] > 0.0 ? counterTotals[phase][counter]/particleTotals[phase] : 0.0;
+}
+
+double Profiler::percentile(int phase, double p, size_t first) const {
+	const std::vector<float> &all = totals[phase];
+	if (first >= all.size())
+		return 0.0;
+
+	std::vector<float> sorted(all.begin() + first, all.end());
+	size_t rank = (size_t)(p/100.0*(sorted.size() - 1) + 0.5);
+	rank = std::min(rank, sorted.size() - 1);
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+void Profiler::report(std::ostream &out) const {
+	char line[160];
+	snprintf(line, sizeof(line), "%-18s %8s %9s %9s %9s %9s", "Phase (ms)", "frames", "p50", "p95", "p99", "max");
+	out << line << std::endl;
+	for (int phase = 0; phase < NUMPHASES; phase++) {
+		if (totals[phase].empty())
+			continue;
+		snprintf(line, sizeof(line), "%-18s %8lu %9.3f %9.3f %9.3f %9.3f", phaseName(phase), (unsigned long)totals[phase].size(),
+				 percentile(phase, 50), percentile(phase, 95), percentile(phase, 99), percentile(phase, 100));
+		out << line << std::endl;
+	}
+
+	if (countCounters) {
+		snprintf(line, sizeof(line), "%-18s %9s %9s %9s %9s %9s %9s", "Phase (/particle)", "cycles", "instr", "IPC", "L1 miss", "LLC miss", "br miss");
+		out << line << std::endl;
+		for (int phase = 0; phase < NUMPHASES; phase++) {
+			if (particleTotals[phase] <= 0.0)
+				continue;
+
+			// Counters this machine couldn't open show as -, not as 0
+			char cells[NUMCOUNTERS][16], ipc[16] = "-";
+			for (int counter = 0; counter < NUMCOUNTERS; counter++) {
+				if (available[counter])
+					snprintf(cells[counter], sizeof(cells[counter]), counter <= COUNTER_INSTRUCTIONS ? "%.2f" : "%.4f", perParticle(phase, counter));
+				else
+					strcpy(cells[counter], "-");
+			}
+			double cycles = counterTotals[phase][COUNTER_CYCLES];
+			if (available[COUNTER_CYCLES] && available[COUNTER_INSTRUCTIONS] && cycles > 0.0)
+				snprintf(ipc, sizeof(ipc), "%.2f", counterTotals[phase][COUNTER_INSTRUCTIONS]/cycles);
+
+			snprintf(line, sizeof(line), "%-18s %9s %9s %9s %9s %9s %9s", phaseName(phase), cells[COUNTER_CYCLES], cells[COUNTER_INSTRUCTIONS],
+					 ipc, cells[COUNTER_L1MISSES], cells[COUNTER_LLCMISSES], cells[COUNTER_BRANCHMISSES]);
+			out << line << std::endl;
+		}
+	}
+
+	out << "Hitches over " << hitchMilliseconds << " ms: " << hitchList.size() << std::endl;
+	if (numDropped() > 0)
+		out << "Samples dropped: " << numDropped() << std::endl;
+}
+
+bool Profiler::write(const std::string &path) const {
+	std::ofstream out(path.c_str());
+	if (!out)
+		return false;
+
+	bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	if (!csv)
+		return writeJson(out);
+
+	out << "phase,frame,milliseconds" << std::endl;
+	for (int phase = 0; phase < NUMPHASES; phase++)
+		for (size_t frame = 0; frame < totals[phase].size(); frame++)
+			out << phaseName(phase) << "," << frame << "," << totals[phase][frame] << std::endl;
+	return (bool)out;
+}
+
+bool Profiler::writeJson(std::ostream &out) const {
+	out << "{" << std::endl;
+	out << "  \"hitchThresholdMs\": " << hitchMilliseconds << "," << std::endl;
+	out << "  \"droppedSamples\": " << numDropped() << "," << std::endl;
+
+	out << "  \"phases\": {";
+	bool firstPhase = true;
+	for (int phase = 0; phase < NUMPHASES; phase++) {
+		if (totals[phase].empty())
+			continue;
+		out << (firstPhase ? "" : ",") << std::endl;
+		firstPhase = false;
+
+		out << "    \"" << phaseName(phase) << "\": {"
+			<< "\"p50\": " << percentile(phase, 50) << ", \"p95\": " << percentile(phase, 95)
+			<< ", \"p99\": " << percentile(phase, 99) << ", \"max\": " << percentile(phase, 100)
+			<< ", \"frames\": [";
+		for (size_t frame = 0; frame < totals[phase].size(); frame++)
+			out << (frame > 0 ? ", " : "") << totals[phase][frame];
+		out << "]";
+		if (countCounters && particleTotals[phase] > 0.0) {
+			out << ", \"perParticle\": {";
+			bool firstCounter = true;
+			for (int counter = 0; counter < NUMCOUNTERS; counter++) {
+				if (!available[counter])
+					continue;
+				out << (firstCounter ? "" : ", ") << "\"" << counterName(counter) << "\": " << perParticle(phase, counter);
+				firstCounter = false;
+			}
+			out << "}";
+		}
+		out << "}";
+	}
+	out << std::endl << "  }," << std::endl;
+
+	out << "  \"hitches\": [";
+	for (size_t i = 0; i < hitchList.size(); i++)
+		out << (i > 0 ? ", " : "") << "{\"frame\": " << hitchList[i].frame << ", \"ms\": " << hitchList[i].milliseconds << "}";
+	out << "]" << std::endl;
+	out << "}" << std::endl;
+	return (bool)out;
+}
+
+//----------------------------------------------------------------------------
+
+void Profiler::nameThread(const std::string &name) {
+	int id = threadId();
+	std::lock_guard<std::mutex> lock(namesMutex);
+	if ((int)threadNames.size() <= id)
+		threadNames.resize(id + 1);
+	threadNames[id] = name;
+}
+
+// An event of a trace: the begin or end of a sample
+typedef struct {
+	int64_t time;
+	bool begin;
+	const ProfileSample *sample;
+} TraceEvent;
+
+// Orders a thread's events so that samples nest: by time, ends before
+// begins, and at the same time the longer sample begins first and ends last
+static bool traceOrder(const TraceEvent &a, const TraceEvent &b) {
+	if (a.time != b.time)
+		return a.time < b.time;
+	if (a.begin != b.begin)
+		return !a.begin;
+	int64_t lengthA = a.sample->end - a.sample->begin;
+	int64_t lengthB = b.sample->end - b.sample->begin;
+	return a.begin ? lengthA > lengthB : lengthA < lengthB;
+}
+
+bool Profiler::writeTrace(const std::string &path) const {
+	std::ofstream out(path.c_str());
+	if (!out)
+		return false;
+
+	std::map< int, std::vector<TraceEvent> > threads;
+	int64_t start = samples.empty() ? 0 : samples[0].begin;
+	for (size_t i = 0; i < samples.size(); i++) {
+		const ProfileSample &sample = samples[i];
+		TraceEvent begin = { sample.begin, true, &sample };
+		TraceEvent end = { sample.end, false, &sample };
+		threads[sample.thread].push_back(begin);
+		threads[sample.thread].push_back(end);
+		start = std::min(start, sample.begin);
+	}
+
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+	bool first = true;
+	char time[32];
+	for (std::map< int, std::vector<TraceEvent> >::iterator thread = threads.begin(); thread != threads.end(); ++thread) {
+		int id = thread->first;
+		std::string name = id < (int)threadNames.size() && !threadNames[id].empty() ? threadNames[id] : "thread " + std::to_string(id);
+		out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << id
+			<< ", \"args\": {\"name\": \"" << name << "\"}}";
+		first = false;
+
+		std::vector<TraceEvent> &events = thread->second;
+		std::sort(events.begin(), events.end(), traceOrder);
+		for (size_t i = 0; i < events.size(); i++) {
+			const TraceEvent &event = events[i];
+			snprintf(time, sizeof(time), "%.3f", (event.time - start)*1e-3);
+			out << ",\n{\"name\": \"" << phaseName(event.sample->phase) << "\", \"ph\": \"" << (event.begin ? "B" : "E")
+				<< "\", \"ts\": " << time << ", \"pid\": 1, \"tid\": " << id;
+			if (event.begin)
+				out << ", \"args\": {\"particles\": " << event.sample->count << ", \"frame\": " << event.sample->frame << "}";
+			out << "}";
+		}
+	}
+	out << std::endl << "]}" << std::endl;
+	return (bool)out;
+}
@@ -0,0 +1,228 @@
+// Frame-phase profiler. Scoped timers around the phases of a frame (spawning,
+// each force's update, compaction, upload, drawing) push samples into a
+// lock-free ring from whichever thread runs them; the thread that owns the
+// profiler drains the ring into per-frame totals, flags the frames that take
+// longer than a threshold, and reports percentiles of every phase. When
+// tracing, it also keeps every sample, down to single kernel chunks and draw
+// calls, and writes them out as Chrome trace events. When counting, each
+// sample also carries the hardware counters of the thread that ran it, and
+// the report adds their totals per particle.
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP 1
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// This file contains the forces, one update phase each
+#include "particle_system.hpp"
+#include "perf_counters.hpp"
+
+#define PROFILERCAPACITY (1 << 16)	// samples the ring holds until they are collected
+#define DEFAULTHITCHMS (1000.0/30.0)	// frames longer than this are hitches
+
+// Phases of a frame. The simulation's phases are counted per step and the
+// renderer's per displayed frame.
+enum {
+	PHASE_FRAME,		// a whole frame: a viewer loop iteration, or a headless step
+	PHASE_SPAWN,		// emitters spawning particles
+	PHASE_UPDATE,		// expiring and stepping one force's particles, PHASE_UPDATE + force
+	PHASE_COMPACT = PHASE_UPDATE + NUMFORCES,	// removing the dead and putting the settled to sleep
+	PHASE_PACK,			// packing particles for the renderer
+	PHASE_UPLOAD,		// sending particles to the GPU
+	PHASE_DRAW,			// issuing the draw calls
+	PHASE_SWAP,			// swapping buffers, which waits for the display
+	PHASE_KERNEL,		// one chunk of a force's kernel, PHASE_KERNEL + force; only timed when tracing or counting
+	PHASE_DRAWCALL = PHASE_KERNEL + NUMFORCES,	// one draw call; only timed when tracing or counting
+	NUMPHASES
+};
+
+typedef struct {
+	int phase;
+	int thread;			// see Profiler::threadId
+	long long frame;	// step or displayed frame the phase ran in
+	long long count;	// particles the phase worked on
+	int64_t begin;		// nanoseconds on the steady clock
+	int64_t end;
+	uint64_t counters[NUMCOUNTERS];	// hardware events on its thread while it ran, 0 when not counting
+	bool counted;					// whether counters holds a reading
+} ProfileSample;
+
+typedef struct {
+	long long frame;
+	double milliseconds;
+} Hitch;
+
+class Profiler {
+public:
+	Profiler(double hitchMilliseconds = DEFAULTHITCHMS);
+	~Profiler();
+
+	// Pushes a sample into the ring. Any thread may call it; it never waits,
+	// and drops the sample (returning false) if the ring is full.
+	bool record(const ProfileSample &sample);
+
+	// Drains the ring into per-frame totals. Only one thread may call it.
+	void collect();
+
+	// Collects what is left and closes the last frame of every phase
+	void finish();
+
+	// Per-frame totals of a phase, in milliseconds, in the order the frames ended
+	const std::vector<float> &frames(int phase) const { return totals[phase]; }
+
+	// The pth percentile (0 to 100) of a phase's per-frame totals from the
+	// first-th frame on, in milliseconds; 0 if there are none
+	double percentile(int phase, double p, size_t first = 0) const;
+
+	// Frames whose PHASE_FRAME took longer than the threshold
+	const std::vector<Hitch> &hitches() const { return hitchList; }
+	double hitchThreshold() const { return hitchMilliseconds; }
+
+	// Prints the percentiles of every phase that ran
+	void report(std::ostream &out) const;
+
+	// Writes the per-frame totals of every phase to path: one
+	// phase,frame,milliseconds row each when it ends in .csv, otherwise JSON
+	// with the percentiles and hitches too. Returns false if it can't.
+	bool write(const std::string &path) const;
+
+	// Samples dropped because the ring was full
+	long long numDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+	// Keeps every sample collected from now on for writeTrace. Turn it on
+	// before other threads start timing: they read it unguarded.
+	void setTracing(bool tracing) { keepSamples = tracing; }
+	bool tracing() const { return keepSamples; }
+
+	// Gives the calling thread a name in traces
+	void nameThread(const std::string &name);
+
+	// Reads hardware counters around every sample from now on. Returns false,
+	// and leaves it off, if the calling thread can't count anything (not
+	// Linux, no PMU, or perf_event_paranoid forbids it). Like tracing, turn it
+	// on before other threads start timing.
+	//
+	// Counters that thread couldn't open (the machine may lack some) are
+	// left out of the report and the JSON.
+	//
+	// A sample counts only the thread it ran on. Force kernels are counted
+	// chunk by chunk on every thread (the PHASE_KERNEL rows), but the parts of
+	// other phases that fan out to the pool aren't.
+	bool setCounting(bool counting);
+	bool counting() const { return countCounters; }
+
+	// A phase's counter summed over every sample, divided by the particles
+	// they worked on; 0 if they worked on none. Samples whose counters
+	// couldn't be read at both ends are left out.
+	double perParticle(int phase, int counter) const;
+
+	// Writes the kept samples to path in the Chrome trace-event format, as a
+	// begin and an end event each with the phase's particle count and frame,
+	// on the threads that ran them; Perfetto and chrome://tracing load it.
+	// Returns false if it can't.
+	bool writeTrace(const std::string &path) const;
+
+	static const char *phaseName(int phase);
+
+	// Nanoseconds on the steady clock
+	static int64_t now();
+
+	// A small number for the calling thread, counting from 0 in the order
+	// threads first ask
+	static int threadId();
+
+private:
+	// A slot of the ring. sequence says whose turn it is: the writer of the
+	// sample at position p waits for p, and the reader for p + 1.
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		ProfileSample sample;
+	};
+
+	void add(const ProfileSample &sample);
+	void close(int phase);
+	bool writeJson(std::ostream &out) const;
+
+	Slot *ring;
+	std::atomic<uint64_t> head;		// next position written
+	uint64_t tail;					// next position read, only by the collecting thread
+	std::atomic<long long> dropped;
+
+	double hitchMilliseconds;
+	std::vector<float> totals[NUMPHASES];
+	long long openFrame[NUMPHASES];	// frame each phase is adding up, -1 for none
+	double openTotal[NUMPHASES];
+	std::vector<Hitch> hitchList;
+
+	bool keepSamples;
+	std::vector<ProfileSample> samples;		// every sample collected while tracing
+	std::mutex namesMutex;
+	std::vector<std::string> threadNames;	// by threadId, empty where unnamed
+
+	bool countCounters;
+	bool available[NUMCOUNTERS];	// counters that opened on the thread that turned counting on
+	double counterTotals[NUMPHASES][NUMCOUNTERS];
+	double particleTotals[NUMPHASES];	// particles the counted samples worked on
+
+	Profiler(const Profiler&);
+	Profiler &operator=(const Profiler&);
+};
+
+// The profiler, only while it is tracing or counting. Timers of single kernel
+// chunks and draw calls get it instead, so they cost nothing otherwise.
+inline Profiler *detailed(Profiler *profiler) {
+	return profiler && (profiler->tracing() || profiler->counting()) ? profiler : NULL;
+}
+
+// Times the scope it lives in as one sample of a phase. With no profiler it
+// does nothing.
+class ProfileTimer {
+public:
+	ProfileTimer(Profiler *profiler, int phase, long long frame, long long count = 0) : profiler(profiler) {
+		if (!profiler)
+			return;
+		sample.phase = phase;
+		sample.thread = Profiler::threadId();
+		sample.frame = frame;
+		sample.count = count;
+		sample.counted = profiler->counting() && readCounters(sample.counters);
+		if (!sample.counted)
+			memset(sample.counters, 0, sizeof(sample.counters));
+		sample.begin = Profiler::now();
+	}
+
+	~ProfileTimer() { stop(); }
+
+	// Ends the sample before the scope does
+	void stop() {
+		if (!profiler)
+			return;
+		sample.end = Profiler::now();
+		if (sample.counted) {
+			uint64_t counters[NUMCOUNTERS];
+			sample.counted = readCounters(counters);
+			for (int counter = 0; counter < NUMCOUNTERS; counter++)
+				sample.counters[counter] = sample.counted ? counters[counter] - sample.counters[counter] : 0;
+		}
+		profiler->record(sample);
+		profiler = NULL;
+	}
+
+	// For phases that only know their particle count once they are done
+	void setCount(long long count) { sample.count = count; }
+
+private:
+	Profiler *profiler;
+	ProfileSample sample;
+
+	ProfileTimer(const ProfileTimer&);
+	ProfileTimer &operator=(const ProfileTimer&);
+};
+
+#endif
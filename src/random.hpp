@@ -0,0 +1,73 @@
+// Counter-based random numbers for the simulation. A number is a pure function
+// of a key and a counter (Widynski's Squares), so the same key and counter give
+// the same number on any thread, in any order. Keys are built from the scene
+// seed and whatever identifies the stream: an emitter and frame for spawning,
+// a frame for the turbulent forces.
+
+#ifndef RANDOM_HPP
+#define RANDOM_HPP 1
+
+#include <stdint.h>
+
+#define RANDOMSEED 0x5eed5eed5eed5eedULL	// seed used unless --seed gives another
+
+// splitmix64's finalizer, used to turn ids into well mixed keys
+inline uint64_t randomMix(uint64_t z) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Key of the stream identified by the seed and up to three ids
+inline uint64_t randomKey(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0) {
+	uint64_t key = randomMix(seed);
+	key = randomMix(key ^ a);
+	key = randomMix(key ^ b);
+	key = randomMix(key ^ c);
+	return key | 1;
+}
+
+// 32 random bits for the counter in the key's stream
+inline uint32_t squares32(uint64_t counter, uint64_t key) {
+	uint64_t x, y, z;
+	y = x = counter*key;
+	z = y + key;
+	x = x*x + y; x = (x >> 32) | (x << 32);
+	x = x*x + z; x = (x >> 32) | (x << 32);
+	x = x*x + y; x = (x >> 32) | (x << 32);
+	return (uint32_t)((x*x + z) >> 32);
+}
+
+// Uniform float in [0, 1) for the counter in the key's stream
+inline float randomFloat(uint64_t counter, uint64_t key) {
+	// The top 24 bits fill a float's mantissa exactly
+	return (float)(squares32(counter, key) >> 8)*(1.0f/16777216.0f);
+}
+
+//----------------------------------------------------------------------------
+
+// A position in a stream: draws read consecutive counters under one key
+class Random {
+public:
+	explicit Random(uint64_t key = randomKey(RANDOMSEED, 0)) : key(key), counter(0) {}
+
+	// Moves to the start of another stream, or to a counter in this one
+	void start(uint64_t key, uint64_t counter = 0) { this->key = key; this->counter = counter; }
+	void seek(uint64_t counter) { this->counter = counter; }
+
+	// One uniform float in [0, 1)
+	float next() { return randomFloat(counter++, key); }
+
+	uint64_t key;
+	uint64_t counter;
+};
+
+// The stream that random() and range() in helper.hpp draw from on the calling
+// thread. ParticleSystem points it at the right key before drawing.
+inline Random &threadRandom() {
+	static thread_local Random stream;
+	return stream;
+}
+
+#endif
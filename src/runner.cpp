@@ -0,0 +1,247 @@
+// Command line parsing and the headless fixed-timestep runner
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+
+#include "profiler.hpp"
+#include "runner.hpp"
+#include "scene.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+//----------------------------------------------------------------------------
+
+static void printUsage(const char *program) {
+	cerr << "usage: " << program << " [--scene name] [--headless] [--frames n] [--dt seconds] [--threads n] [--chunk n] [--seed n] [--max-particles n] [--upload mode] [--stateless] [--profile file] [--hitch ms] [--trace file] [--counters]" << endl;
+	cerr << "  --scene     art, fire, water_fountain, bouncing_ball or fireworks" << endl;
+	cerr << "  --headless  step the scene without a window and print throughput" << endl;
+	cerr << "  --frames    number of headless steps (default 1000)" << endl;
+	cerr << "  --dt        seconds per headless step, as a number or a fraction like 1/60 (default 1/60)" << endl;
+	cerr << "  --threads   threads stepping the particles, 0 for one per hardware thread (default 0)" << endl;
+	cerr << "  --chunk     particles per parallel task (default " << DEFAULTCHUNKSIZE << ")" << endl;
+	cerr << "  --seed      seed for every random number, so a run can be replayed exactly" << endl;
+	cerr << "  --max-particles  cap on live particles, 0 for none (default 0)" << endl;
+	cerr << "  --upload    how the viewer streams particles: auto, persistent or orphan (default auto)" << endl;
+	cerr << "  --stateless only age firework trails and sparks; the vertex shader moves and colors them" << endl;
+	cerr << "  --profile   write the time every phase took each frame to a file on exit, as CSV if it ends in .csv and JSON otherwise" << endl;
+	cerr << "  --hitch     report frames taking longer than this many milliseconds (default " << DEFAULTHITCHMS << ")" << endl;
+	cerr << "  --counters  report cycles, instructions, cache and branch misses per particle of every phase (Linux)" << endl;
+	cerr << "  --trace     write every phase, kernel chunk and draw call to a Chrome trace file (JSON) on exit, for Perfetto" << endl;
+}
+
+bool parseSeconds(const char *text, double &seconds) {
+	char *end;
+	double value = strtod(text, &end);
+	if (end == text)
+		return false;
+
+	if (*end == '/') {
+		const char *denominator = end + 1;
+		double divisor = strtod(denominator, &end);
+		if (end == denominator || divisor == 0.0)
+			return false;
+		value /= divisor;
+	}
+
+	if (*end != '\0' || value <= 0.0)
+		return false;
+
+	seconds = value;
+	return true;
+}
+
+bool parseRunOptions(int argc, char** argv, const string &defaultScene, RunOptions &options) {
+	options.headless = false;
+	options.scene = defaultScene;
+	options.frames = 1000;
+	options.dt = 1.0/60.0;
+	options.threads = 0;
+	options.chunkSize = DEFAULTCHUNKSIZE;
+	options.seed = RANDOMSEED;
+	options.maxParticles = 0;
+	options.upload = UPLOAD_AUTO;
+	options.stateless = false;
+	options.profilePath = "";
+	options.hitchMs = DEFAULTHITCHMS;
+	options.counters = false;
+	options.tracePath = "";
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--headless") == 0) {
+			options.headless = true;
+			continue;
+		}
+		else if (strcmp(arg, "--stateless") == 0) {
+			options.stateless = true;
+			continue;
+		}
+		else if (strcmp(arg, "--counters") == 0) {
+			options.counters = true;
+			continue;
+		}
+		else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+			printUsage(argv[0]);
+			return false;
+		}
+
+		// Everything else takes a value
+		bool ok = value != NULL;
+		if (ok && strcmp(arg, "--scene") == 0) {
+			options.scene = value;
+		}
+		else if (ok && strcmp(arg, "--frames") == 0) {
+			char *end;
+			options.frames = strtol(value, &end, 10);
+			ok = *end == '\0' && options.frames > 0;
+		}
+		else if (ok && strcmp(arg, "--dt") == 0) {
+			ok = parseSeconds(value, options.dt);
+		}
+		else if (ok && strcmp(arg, "--threads") == 0) {
+			char *end;
+			options.threads = strtol(value, &end, 10);
+			ok = *end == '\0' && options.threads >= 0;
+		}
+		else if (ok && strcmp(arg, "--chunk") == 0) {
+			char *end;
+			options.chunkSize = strtol(value, &end, 10);
+			ok = *end == '\0' && options.chunkSize > 0;
+		}
+		else if (ok && strcmp(arg, "--seed") == 0) {
+			char *end;
+			options.seed = strtoull(value, &end, 0);
+			ok = *end == '\0' && *value != '\0' && *value != '-';
+		}
+		else if (ok && strcmp(arg, "--max-particles") == 0) {
+			char *end;
+			options.maxParticles = strtoll(value, &end, 10);
+			ok = *end == '\0' && *value != '\0' && options.maxParticles >= 0;
+		}
+		else if (ok && strcmp(arg, "--profile") == 0) {
+			options.profilePath = value;
+		}
+		else if (ok && strcmp(arg, "--trace") == 0) {
+			options.tracePath = value;
+		}
+		else if (ok && strcmp(arg, "--hitch") == 0) {
+			char *end;
+			options.hitchMs = strtod(value, &end);
+			ok = end != value && *end == '\0' && options.hitchMs > 0.0;
+		}
+		else if (ok && strcmp(arg, "--upload") == 0) {
+			if (strcmp(value, "auto") == 0)
+				options.upload = UPLOAD_AUTO;
+			else if (strcmp(value, "persistent") == 0)
+				options.upload = UPLOAD_PERSISTENT;
+			else if (strcmp(value, "orphan") == 0)
+				options.upload = UPLOAD_ORPHAN;
+			else
+				ok = false;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			cerr << "bad argument: " << arg << (value ? string(" ") + value : string()) << endl;
+			printUsage(argv[0]);
+			return false;
+		}
+		i++;
+	}
+
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+int runHeadless(const RunOptions &options) {
+	// Seed before creating the scene, which draws random numbers as it sets up
+	ParticleSystem *system = new ParticleSystem(options.maxParticles);
+	system->setThreads(options.threads, options.chunkSize);
+	system->setSeed(options.seed);
+	system->setStateless(options.stateless);
+
+	Scene *scene = createScene(options.scene);
+	if (!scene) {
+		cerr << "unknown scene: " << options.scene << endl;
+		delete system;
+		return EXIT_FAILURE;
+	}
+	scene->init(*system);
+
+	Profiler profiler(options.hitchMs);
+	profiler.setTracing(!options.tracePath.empty());
+	if (options.counters && !profiler.setCounting(true))
+		cerr << "hardware counters aren't available" << endl;
+	profiler.nameThread("main");
+	system->setProfiler(&profiler);
+
+	// Only the stepping is timed, not the scene setup
+	long long spawned = system->numSpawned;
+	long long killed = system->numKilled;
+	long long updated = system->numUpdated;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long frame = 0; frame < options.frames; frame++) {
+		ProfileTimer timer(&profiler, PHASE_FRAME, system->frame, system->numParticles);
+		scene->spawn(*system, options.dt);
+		system->update(options.dt);
+		timer.stop();
+		profiler.collect();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	if (seconds <= 0.0)
+		seconds = 1e-9;
+
+	spawned = system->numSpawned - spawned;
+	killed = system->numKilled - killed;
+	updated = system->numUpdated - updated;
+
+	cout << "Scene: " << options.scene << endl;
+	cout << "--- Seed: " << options.seed << endl;
+	cout << "--- Frames: " << options.frames << " x " << options.dt << " s (" << options.frames*options.dt << " s simulated)" << endl;
+	cout << "--- Threads: " << system->numThreads() << " (chunks of " << options.chunkSize << ")" << endl;
+	if (options.stateless)
+		cout << "--- Stateless firework trails and sparks" << endl;
+	cout << "--- Wall time: " << seconds << " s (" << 1000.0*seconds/options.frames << " ms/frame)" << endl;
+	cout << "--- Particles updated/sec: " << updated/seconds << endl;
+	cout << "--- Spawns/sec: " << spawned/seconds << endl;
+	cout << "--- Kills/sec: " << killed/seconds << endl;
+	cout << "--- # of Particles: " << system->numParticles << endl;
+	if (options.maxParticles > 0)
+		cout << "--- Particle cap: " << options.maxParticles << endl;
+	// What a slot of each particle's group takes, and what the groups have
+	// allocated (slack capacity and expiry queues included) per live particle
+	long long layoutBytes = 0;
+	for (int force = 0; force < NUMFORCES; force++)
+		layoutBytes += (long long)system->groups[force].numParticles*system->groups[force].bytesPerParticle();
+	cout << "--- Layout bytes/particle: " << (system->numParticles > 0 ? layoutBytes/system->numParticles : 0) << endl;
+	cout << "--- Allocated bytes/particle: " << (system->numParticles > 0 ? system->bytes()/system->numParticles : 0) << endl;
+	char hash[32];
+	snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)system->hash());
+	cout << "--- State hash: " << hash << endl;
+
+	system->setProfiler(NULL);
+	profiler.finish();
+	profiler.report(cout);
+	if (!options.profilePath.empty() && !profiler.write(options.profilePath))
+		cerr << "couldn't write " << options.profilePath << endl;
+	if (!options.tracePath.empty() && !profiler.writeTrace(options.tracePath))
+		cerr << "couldn't write " << options.tracePath << endl;
+
+	delete system;
+	delete scene;
+	return EXIT_SUCCESS;
+}
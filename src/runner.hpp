@@ -0,0 +1,43 @@
+// Command line options for the demo executables, and the headless runner that
+// steps a scene with a fixed time step and no window or OpenGL context.
+
+#ifndef RUNNER_HPP
+#define RUNNER_HPP 1
+
+#include <string>
+
+// How the viewer streams particle vertices to the GPU: through a persistently
+// mapped ring when the context supports it, or by orphaning a buffer
+enum { UPLOAD_AUTO, UPLOAD_PERSISTENT, UPLOAD_ORPHAN };
+
+typedef struct {
+	bool headless;		// step without a window and report throughput
+	std::string scene;	// scene to run (see createScene)
+	long frames;		// number of steps to take when headless
+	double dt;			// seconds per step when headless
+	int threads;		// threads stepping the particles, 0 for one per hardware thread
+	int chunkSize;		// particles per parallel task
+	unsigned long long seed;	// seed for all random numbers (ParticleSystem::setSeed)
+	long long maxParticles;		// cap on live particles, 0 for none
+	int upload;			// UPLOAD_AUTO, UPLOAD_PERSISTENT or UPLOAD_ORPHAN
+	bool stateless;		// evaluate firework trails and sparks in the vertex shader (ParticleSystem::setStateless)
+	std::string profilePath;	// where to write the frame-phase timings on exit (see Profiler::write), empty for nowhere
+	double hitchMs;		// frames longer than this many milliseconds are reported as hitches
+	bool counters;		// read hardware counters around every phase (see Profiler::setCounting)
+	std::string tracePath;	// where to write a Chrome trace of every phase on exit (see Profiler::writeTrace), empty for nowhere
+} RunOptions;
+
+// Reads a time step written as a number ("0.01") or a fraction ("1/60");
+// returns false unless it is a positive number
+bool parseSeconds(const char *text, double &seconds);
+
+// Fills options from the command line, starting from the given scene name.
+// Prints the usage and returns false if the arguments can't be parsed.
+bool parseRunOptions(int argc, char** argv, const std::string &defaultScene, RunOptions &options);
+
+// Steps the scene for options.frames fixed steps, then prints particles
+// updated, spawned and killed per second of wall time and the percentiles of
+// every phase of a step
+int runHeadless(const RunOptions &options);
+
+#endif
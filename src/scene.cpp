@@ -0,0 +1,523 @@
+// Demo scenes, moved out of the individual demo executables
+
+#include "scene.hpp"
+
+//----------------------------------------------------------------------------
+// A firework rocket: the trail emitter rises and falls, and the explosion
+// emitter fires for a short moment once the rocket starts falling. The
+// programs are the emitters compiled for spawning.
+typedef struct {
+	Emitter trail;
+	Emitter explosion;
+	SpawnProgram trailProgram;
+	SpawnProgram explosionProgram;
+	double timer;
+} Firework;
+
+// Uses emitter ids id and id + 1
+static void initFirework(Firework &firework, int id) {
+	firework.trail = {
+		{ // Shape
+			"disk", 1, .5, 5
+		},
+		{ // Particle properties
+			{ // colorStartRange
+				{0.6, 0.6, 0.6, 1.0},
+				{0.8, 0.8, 0.8, 1.0}
+			},
+			{ // colorEndRange
+				{0.0, 0.0, 0.0, 1.0},
+				{1.0, 1.0, 1.0, 1.0}
+			},
+			{2, 3}, // colorSpeedRange
+			{2, 3}, // lifetimeRange
+			{MAXSIZE/2, MAXSIZE/2}, // sizeRange
+			{1.0, 1.0}, // blurRange
+			{Vec3f(-0.5, 0.0, -0.5), Vec3f(0.5, -1.0, 0.5)}, // velocityRange
+			0, // lighting
+			FORCE_FIREWORK // force
+		},
+		300.0, // genRate
+		Vec3f(100 * random(1000, true), 0, 200 * random(1000, false)), // position
+		Vec3f(2 * random(1000, true), 0, 2 * random(1000, true)), // velocity
+		Vec3f(0, 1, 0), // direction
+		id, // id
+	};
+
+	firework.explosion = {
+		{ // Shape
+			"disk", 1, .5, 5
+		},
+		{ // Particle properties
+			{ // colorStartRange
+				{0.6, 0.6, 0.6, 1.0},
+				{0.8, 0.8, 0.8, 1.0}
+			},
+			{ // colorEndRange
+				{0.0, 0.0, 0.0, 1.0},
+				{1.0, 1.0, 1.0, 1.0}
+			},
+			{.7, 1.0}, // colorSpeedRange
+			{2, 3}, // lifetimeRange
+			{MAXSIZE, MAXSIZE}, // sizeRange
+			{1.0, 1.0}, // blurRange
+			{Vec3f(-10, -10, -10), Vec3f(10, 10, 10)}, // velocityRange
+			0, // lighting
+			FORCE_EXPLOSION // force
+		},
+		10000.0, // genRate
+		Vec3f(0, 0, 0), // position
+		Vec3f(0, 0, 0), // velocity
+		Vec3f(0, 1, 0), // direction
+		id + 1, // id
+	};
+
+	firework.trailProgram = compileEmitter(firework.trail);
+	firework.explosionProgram = compileEmitter(firework.explosion);
+	firework.timer = 5;
+}
+
+static void updateFirework(ParticleSystem &system, Firework &firework, double dt) {
+	Emitter &trail = firework.trail;
+	Emitter &explosion = firework.explosion;
+
+	firework.timer += dt;
+
+	if (trail.position[1] <= 0.0) {
+		trail.velocity[1] = 20 + 30*random(1000, false);
+	}
+	if (trail.velocity[1] < -0.5) {
+		explosion.position[0] = trail.position[0];
+		explosion.position[1] = trail.position[1];
+		explosion.position[2] = trail.position[2];
+		firework.timer = 0.0;
+
+		explosion.properties.colorStartRange[0][0] = random(1000, false);
+		explosion.properties.colorStartRange[0][1] = random(1000, false);
+		explosion.properties.colorStartRange[0][2] = random(1000, false);
+		explosion.properties.colorStartRange[1][0] = explosion.properties.colorStartRange[0][0];
+		explosion.properties.colorStartRange[1][1] = explosion.properties.colorStartRange[0][1];
+		explosion.properties.colorStartRange[1][2] = explosion.properties.colorStartRange[0][2];
+
+		explosion.properties.colorEndRange[0][0] = random(1000, false);
+		explosion.properties.colorEndRange[0][1] = random(1000, false);
+		explosion.properties.colorEndRange[0][2] = random(1000, false);
+		explosion.properties.colorEndRange[1][0] = explosion.properties.colorEndRange[0][0];
+		explosion.properties.colorEndRange[1][1] = explosion.properties.colorEndRange[0][1];
+		explosion.properties.colorEndRange[1][2] = explosion.properties.colorEndRange[0][2];
+
+		trail.position[0] = 100.0 * random(1000, true);
+		trail.position[1] = 0.0;
+		trail.position[2] = 200.0 * random(1000, false);
+
+		trail.velocity[0] = 2 * random(1000, true);
+		trail.velocity[1] = 0.0;
+		trail.velocity[2] = 2 * random(1000, true);
+
+		firework.explosionProgram = compileEmitter(explosion);
+	}
+	trail.position[0] += dt*trail.velocity[0];
+	trail.position[1] += dt*trail.velocity[1] - dt*dt*GRAVITY/2.0;
+	trail.position[2] += dt*trail.velocity[2];
+	trail.velocity[1] -= dt*GRAVITY;
+	firework.trailProgram.position = trail.position;
+
+	// Spawn new fireworks particles
+	system.spawnParticles(firework.trailProgram, dt);
+
+	// Spawn new explosion particles for a short moment of time
+	if (firework.timer < 0.6) {
+		system.spawnParticles(firework.explosionProgram, dt);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Fire and smoke emitters, shared by the art and fire scenes
+
+static Emitter fireEmitterAt(Vec3f position, int id) {
+	Emitter emitter = {
+		{ // Shape
+			"disk", 1.5, .5, 5
+		},
+		{ // Particle properties
+			{ // colorStartRange
+				{0.9, 0.7, 0.1, 1.0},
+				{1.0, 0.8, 0.3, 1.0}
+			},
+			{ // colorEndRange
+				{0.9, 0.2, 0.0, 0.2},
+				{1.0, 0.3, 0.1, 0.7}
+			},
+			{.7, .9}, // colorSpeedRange
+			{1.5, 1.75}, // lifetimeRange
+			{MAXSIZE/2, MAXSIZE}, // sizeRange
+			{1.0, 1.0}, // blurRange
+			{Vec3f(-1.1, 1, -1.2), Vec3f(1, 3.5, 1)}, // velocityRange
+			0, // lighting
+			FORCE_FIRE // force
+		},
+		6000.0, // genRate
+		position, // position
+		Vec3f(0, 0, 0), // velocity
+		Vec3f(0, 1, 0), // direction
+		id, // id
+	};
+	return emitter;
+}
+
+static Emitter smokeEmitterAt(Vec3f position, int id) {
+	Emitter emitter = {
+		{ // Shape
+			"disk", .25, .5, 5
+		},
+		{ // Particle properties
+			{ // colorStartRange
+				{0.4, 0.4, 0.4, 0.3},
+				{0.4, 0.4, 0.4, 1.0}
+			},
+			{ // colorEndRange
+				{0.1, 0.1, 0.1, 1.0},
+				{0.1, 0.1, 0.1, 1.0}
+			},
+			{.1, .3}, // colorSpeedRange
+			{3, 7}, // lifetimeRange
+			{MAXSIZE, MAXSIZE}, // sizeRange
+			{1.0, 1.0}, // blurRange
+			{Vec3f(-.4, .5, -.5), Vec3f(.5, 2.5, .5)}, // velocityRange
+			0, // lighting
+			FORCE_SMOKE // force
+		},
+		2000.0, // genRate
+		position, // position
+		Vec3f(0, 0, 0), // velocity
+		Vec3f(0, 1, 0), // direction
+		id, // id
+	};
+	return emitter;
+}
+
+static Emitter waterEmitterAt(Vec3f position, int id) {
+	Emitter emitter = {
+		{ // Shape
+			"disk", .25, 1, 5, true
+		},
+		{ // Particle properties
+			{ // colorStartRange
+				{1.0, 1.0, 1.0, 1.0},
+				{1.0, 1.0, 1.0, 1.0}
+			},
+			{ // colorEndRange
+				{0.0, 0.0, 0.8, 1.0},
+				{0.0, 0.0, 0.8, 1.0}
+			},
+			{.7, .9}, // colorSpeedRange
+			{8, 8}, // lifetimeRange
+			{3*MAXSIZE/4, MAXSIZE}, // sizeRange
+			{0.0, 0.0}, // blurRange
+			{Vec3f(4.9, 10, 4.9), Vec3f(5, 11, 5)}, // velocityRange
+			0, // lighting
+			FORCE_WATER // force
+		},
+		20000.0, // genRate
+		position, // position
+		Vec3f(0, 0, 0), // velocity
+		Vec3f(0, 1, 0), // direction
+		id, // id
+	};
+	return emitter;
+}
+
+static void setView(SceneView &view, Vec3f eye, float farPlane, float r, float g, float b, float a, float specTerm) {
+	view.eye = eye;
+	view.farPlane = farPlane;
+	view.clearColor[0] = r;
+	view.clearColor[1] = g;
+	view.clearColor[2] = b;
+	view.clearColor[3] = a;
+	view.specTerm = specTerm;
+}
+
+//----------------------------------------------------------------------------
+// Everything at once: fireworks, a fountain, a campfire, bubbles and balls
+
+#define NUMARTFIREWORKS 5
+
+class ArtScene : public Scene {
+public:
+	ArtScene() : timer(0) {
+		setView(view, Vec3f(0.0, 7.0, 70.0), 10000.0, 0.0, 0.0, 0.0, 1.0, 80.0);
+
+		for (int i = 0; i < NUMARTFIREWORKS; i++)
+			initFirework(fireworks[i], 2*i);
+
+		waterEmitter = compileEmitter(waterEmitterAt(Vec3f(0, .1, 100), 2*NUMARTFIREWORKS));
+		fireEmitter = compileEmitter(fireEmitterAt(Vec3f(0, 4, 100), 2*NUMARTFIREWORKS + 1));
+		smokeEmitter = compileEmitter(smokeEmitterAt(Vec3f(0, 4.75, 100), 2*NUMARTFIREWORKS + 2));
+
+		Emitter bubble = {
+			{ // Shape
+				"ring", 12, 20, 5
+			},
+			{ // Particle properties
+				{ // colorStartRange
+					{1.0, 1.0, 1.0, 1.0},
+					{1.0, 1.0, 1.0, 1.0}
+				},
+				{ // colorEndRange
+					{1.0, 1.0, 1.0, 1.0},
+					{1.0, 1.0, 1.0, 1.0}
+				},
+				{.7, .9}, // colorSpeedRange
+				{4, 8}, // lifetimeRange
+				{MAXSIZE/2, MAXSIZE}, // sizeRange
+				{0.01, 0.01}, // blurRange
+				{Vec3f(-1, .5, -1), Vec3f(1, 2, 1)}, // velocityRange
+				1, // lighting
+				FORCE_BUBBLE // force
+			},
+			250.0, // genRate
+			Vec3f(0, .5, 100), // position
+			Vec3f(0, 0, 0), // velocity
+			Vec3f(0, 1, 0), // direction
+			2*NUMARTFIREWORKS + 3, // id
+		};
+		bubbleEmitter = compileEmitter(bubble);
+
+		Emitter ball = {
+			{ // Shape
+				"ring", 20, 100, 5
+			},
+			{ // Particle properties
+				{ // colorStartRange
+					{0.0, 0.0, 0.0, 1.0},
+					{1.0, 1.0, 1.0, 1.0}
+				},
+				{ // colorEndRange
+					{0.0, 0.0, 0.0, 1.0},
+					{1.0, 1.0, 1.0, 1.0}
+				},
+				{.7, .9}, // colorSpeedRange
+				{4, 8}, // lifetimeRange
+				{MAXSIZE/8, MAXSIZE}, // sizeRange
+				{0.0, 0.0}, // blurRange
+				{Vec3f(0, 0, 0), Vec3f(0, 0, 0)}, // velocityRange
+				1, // lighting
+				FORCE_BALL // force
+			},
+			50.0, // genRate
+			Vec3f(0, 50, 100), // position
+			Vec3f(0, 0, 0), // velocity
+			Vec3f(0, 1, 0), // direction
+			2*NUMARTFIREWORKS + 4, // id
+		};
+		ballEmitter = compileEmitter(ball);
+	}
+
+	// Fire and sparks die about in spawn order (see FireScene and FireworksScene)
+	void init(ParticleSystem &system) {
+		system.setRing(FORCE_FIRE, true);
+		system.setRing(FORCE_EXPLOSION, true);
+	}
+
+	void spawn(ParticleSystem &system, double dt) {
+		timer += dt;
+
+		// Update the firework emitters
+		if (timer > 2.25)
+			for (int i = 0; i < NUMARTFIREWORKS; i++)
+				updateFirework(system, fireworks[i], dt);
+
+		// Spawn new water particles
+		system.spawnParticles(waterEmitter, dt);
+
+		// Spawn new fire particles
+		if (timer > 4.5)
+			system.spawnParticles(fireEmitter, dt);
+
+		// Spawn new smoke particles
+		if (timer > 5)
+			system.spawnParticles(smokeEmitter, dt);
+
+		// Spawn new bubble particles
+		if (timer > 4)
+			system.spawnParticles(bubbleEmitter, dt);
+
+		// Spawn new ball particles
+		system.spawnParticles(ballEmitter, dt);
+	}
+
+private:
+	Firework fireworks[NUMARTFIREWORKS];
+	SpawnProgram waterEmitter, fireEmitter, smokeEmitter, bubbleEmitter, ballEmitter;
+	double timer;
+};
+
+//----------------------------------------------------------------------------
+// A campfire with smoke rising off of it
+
+class FireScene : public Scene {
+public:
+	FireScene() : timer(0) {
+		setView(view, Vec3f(0.0, 7.0, -5.0), 10000.0, 0.0, 0.0, 0.0, 1.0, -1.0);
+
+		fireEmitter = compileEmitter(fireEmitterAt(Vec3f(0, 0, 10), 0));
+		smokeEmitter = compileEmitter(smokeEmitterAt(Vec3f(0, .75, 10), 1));
+	}
+
+	// Fire lives 1.5 to 1.75 seconds, so it dies about in spawn order
+	void init(ParticleSystem &system) {
+		system.setRing(FORCE_FIRE, true);
+	}
+
+	void spawn(ParticleSystem &system, double dt) {
+		// Update fire emitter
+		system.spawnParticles(fireEmitter, dt);
+
+		// Update smoke emitter
+		timer += dt;
+		if (timer > .5)
+			system.spawnParticles(smokeEmitter, dt);
+	}
+
+private:
+	SpawnProgram fireEmitter, smokeEmitter;
+	double timer;
+};
+
+//----------------------------------------------------------------------------
+// A water fountain pooling on the ground
+
+class WaterFountainScene : public Scene {
+public:
+	WaterFountainScene() {
+		setView(view, Vec3f(0.0, 1.0, 45.0), 1000.0, 0.3, 0.3, 0.3, 0.3, 80.0);
+
+		waterEmitter = compileEmitter(waterEmitterAt(Vec3f(0, 0, 50), 0));
+	}
+
+	void spawn(ParticleSystem &system, double dt) {
+		system.spawnParticles(waterEmitter, dt);
+	}
+
+private:
+	SpawnProgram waterEmitter;
+};
+
+//----------------------------------------------------------------------------
+// A red ball and a rain of colored balls that bounce forever
+
+#define NUMBALLS 300000
+
+class BouncingBallScene : public Scene {
+public:
+	BouncingBallScene() {
+		setView(view, Vec3f(0.0, 3.0, -4.0), 500.0, 1.0, 1.0, 1.0, 1.0, 80.0);
+	}
+
+	void init(ParticleSystem &system) {
+		ParticleGroup &balls = system.groups[FORCE_BOUNCE];
+		int i, p;
+
+		p = system.add(FORCE_BOUNCE);
+		if (p < 0)
+			return;
+		balls.particles[p] = Vec3f(0.0, 15.0, 5.0);
+		balls.colors[p][0] = 255;
+		balls.colors[p][1] = 0;
+		balls.colors[p][2] = 0;
+		balls.colors[p][3] = 255;
+		balls.lightings[p] = 255;
+		balls.sizes[p] = packSize(MAXSIZE);
+		balls.blurs[p] = 0;
+
+		balls.velocities[p] = Vec3f(0.0, 1.0, 0.0);
+
+		// As many as fit under the particle cap
+		for (i = 1; i < NUMBALLS; i++) {
+			p = system.add(FORCE_BOUNCE);
+			if (p < 0)
+				break;
+
+			if (i < 5) {
+				balls.particles[p][0] = 5.0 * random(10000, true);
+				balls.particles[p][1] = 60 + 15  * random(10000, false);
+				balls.particles[p][2] = 5.0 * random(10000, false);
+			}
+			else if (i < 25) {
+				balls.particles[p][0] = 5.0 * random(10000, true);
+				balls.particles[p][1] = 130 + 20  * random(10000, false);
+				balls.particles[p][2] = 5.0 * random(10000, false);
+			}
+			else {
+				balls.particles[p][0] = 100.0 * random(10000, true);
+				balls.particles[p][1] = 750 + 2000.0 * random(10000, false);
+				balls.particles[p][2] = 200.0 * random(10000, false);
+			}
+
+			balls.colors[p][0] = packUnorm8(0.1 + random(90, false));
+			balls.colors[p][1] = packUnorm8(0.1 + random(90, false));
+			balls.colors[p][2] = packUnorm8(0.1 + random(90, false));
+			balls.colors[p][3] = 255;
+
+			float speed = i < 25 ? 3 : 10;
+			balls.velocities[p][0] = speed * random(10000, true);
+			balls.velocities[p][1] = speed * random(10000, true);
+			balls.velocities[p][2] = speed * random(10000, true);
+
+			balls.lightings[p] = 255;
+			balls.sizes[p] = packSize(25 + (MAXSIZE-25)*random(1000, false));
+			balls.blurs[p] = 0;
+		}
+	}
+
+	void spawn(ParticleSystem &, double) {}
+};
+
+//----------------------------------------------------------------------------
+// A show of firework rockets
+
+#define NUMFIREWORKS 10
+
+class FireworksScene : public Scene {
+public:
+	FireworksScene() {
+		setView(view, Vec3f(0.0, 7.0, -8.0), 10000.0, 0.0, 0.0, 0.0, 1.0, -1.0);
+
+		for (int i = 0; i < NUMFIREWORKS; i++)
+			initFirework(fireworks[i], 2*i);
+	}
+
+	// Sparks come in bursts that all live 2 to 3 seconds
+	void init(ParticleSystem &system) {
+		system.setRing(FORCE_EXPLOSION, true);
+	}
+
+	void spawn(ParticleSystem &system, double dt) {
+		for (int i = 0; i < NUMFIREWORKS; i++)
+			updateFirework(system, fireworks[i], dt);
+	}
+
+private:
+	Firework fireworks[NUMFIREWORKS];
+};
+
+//----------------------------------------------------------------------------
+
+Scene *createScene(const std::string &name) {
+	Scene *scene = NULL;
+
+	if (name == "art")
+		scene = new ArtScene();
+	else if (name == "fire")
+		scene = new FireScene();
+	else if (name == "water_fountain")
+		scene = new WaterFountainScene();
+	else if (name == "bouncing_ball")
+		scene = new BouncingBallScene();
+	else if (name == "fireworks")
+		scene = new FireworksScene();
+
+	if (scene)
+		scene->name = name;
+	return scene;
+}
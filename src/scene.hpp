@@ -0,0 +1,38 @@
+// Demo scenes: the emitters and emitter logic of each demo, plus the camera
+// settings the viewer uses to display them. Like the particle system itself,
+// scenes do not depend on GLFW or OpenGL.
+
+#ifndef SCENE_HPP
+#define SCENE_HPP 1
+
+#include <string>
+
+#include "particle_system.hpp"
+
+// Camera and shading settings for displaying a scene
+typedef struct {
+	Vec3f eye;
+	float farPlane;
+	float clearColor[4];
+	float specTerm;
+} SceneView;
+
+class Scene {
+public:
+	virtual ~Scene() {}
+
+	// Sets up particles that exist before the first step
+	virtual void init(ParticleSystem &) {}
+
+	// Moves the emitters and spawns their particles for a step of dt seconds
+	virtual void spawn(ParticleSystem &system, double dt) = 0;
+
+	std::string name;
+	SceneView view;
+};
+
+// Creates a scene by name ("art", "fire", "water_fountain", "bouncing_ball" or
+// "fireworks"); returns NULL if there is no scene with that name
+Scene *createScene(const std::string &name);
+
+#endif
@@ -0,0 +1,104 @@
+// Thin wrappers over the SSE2 or AVX2 intrinsics that the particle kernels use,
+// so every kernel is written once for whichever width is compiled in. AVX2 is
+// used when the compiler targets it (ENABLE_AVX2 in CMake), SSE2 on any other
+// x86 build, and SIMD_WIDTH is 1 (plain scalar loops) everywhere else.
+
+#ifndef SIMD_HPP
+#define SIMD_HPP 1
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SIMD_WIDTH 4
+#else
+	#define SIMD_WIDTH 1
+#endif
+
+#if SIMD_WIDTH > 1
+namespace simd {
+
+#if SIMD_WIDTH == 8
+
+typedef __m256 Floats;
+
+inline Floats load(const float *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Floats v) { _mm256_storeu_ps(p, v); }
+inline Floats set1(float x) { return _mm256_set1_ps(x); }
+inline Floats add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+
+// -1, 0 or 1 in every lane, like sgn
+inline Floats sign(Floats v) {
+	Floats zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	return _mm256_sub_ps(_mm256_and_ps(_mm256_cmp_ps(zero, v, _CMP_LT_OQ), one),
+						 _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ), one));
+}
+
+#else
+
+typedef __m128 Floats;
+
+inline Floats load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Floats v) { _mm_storeu_ps(p, v); }
+inline Floats set1(float x) { return _mm_set1_ps(x); }
+inline Floats add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+
+inline Floats sign(Floats v) {
+	Floats zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	return _mm_sub_ps(_mm_and_ps(_mm_cmplt_ps(zero, v), one),
+					  _mm_and_ps(_mm_cmplt_ps(v, zero), one));
+}
+
+#endif
+
+// Ages SIMD_WIDTH particles by their aging rates times dt and returns the new
+// ages
+inline Floats age(float *ages, const float *agingRates, float dt) {
+	Floats lived = add(load(ages), mul(load(agingRates), set1(dt)));
+	store(ages, lived);
+	return lived;
+}
+
+// Steps the color mixes of SIMD_WIDTH particles toward 1, like step
+inline void stepMixes(float *mixes, const float *colorSpeeds, float dt) {
+	Floats mix = load(mixes);
+	store(mixes, add(mix, mul(sub(set1(1.0f), mix), mul(load(colorSpeeds), set1(dt)))));
+}
+
+// Blends the RGBA8 colors of four particles from their start to their end
+// colors, (start*(256 - w) + end*w + 128) >> 8 with w = mix*256 rounded, in
+// 16-bit lanes. SSE2 is there in AVX2 builds too, so both use this.
+inline void blendColors4(uint8_t *out, const uint8_t *starts, const uint8_t *ends, const float *mixes) {
+	__m128 mix = _mm_min_ps(_mm_loadu_ps(mixes), _mm_set1_ps(1.0f));
+	__m128i weights = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(mix, _mm_set1_ps(256.0f)), _mm_set1_ps(0.5f)));
+
+	// Repeat every particle's weight for its four channels
+	weights = _mm_packs_epi32(weights, weights);
+	weights = _mm_unpacklo_epi16(weights, weights);
+	__m128i lowWeights = _mm_unpacklo_epi32(weights, weights);
+	__m128i highWeights = _mm_unpackhi_epi32(weights, weights);
+
+	__m128i zero = _mm_setzero_si128(), full = _mm_set1_epi16(256), half = _mm_set1_epi16(128);
+	__m128i start = _mm_loadu_si128((const __m128i*)starts);
+	__m128i end = _mm_loadu_si128((const __m128i*)ends);
+
+	__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(start, zero), _mm_sub_epi16(full, lowWeights)),
+								_mm_mullo_epi16(_mm_unpacklo_epi8(end, zero), lowWeights));
+	__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(start, zero), _mm_sub_epi16(full, highWeights)),
+								 _mm_mullo_epi16(_mm_unpackhi_epi8(end, zero), highWeights));
+	low = _mm_srli_epi16(_mm_add_epi16(low, half), 8);
+	high = _mm_srli_epi16(_mm_add_epi16(high, half), 8);
+	_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(low, high));
+}
+
+}
+#endif
+
+#endif
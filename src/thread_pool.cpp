@@ -0,0 +1,98 @@
+// Persistent worker pool and chunked parallel-for
+
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+//----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int numThreads) : job(0), busyWorkers(0), stopping(false),
+	body(NULL), count(0), chunkSize(1), nextChunk(0) {
+
+	if (numThreads <= 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	// The thread calling parallelFor does its share of the work too
+	for (int i = 1; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+//----------------------------------------------------------------------------
+
+void ThreadPool::parallelFor(int count, int chunkSize, const std::function<void(int, int)> &body) {
+	if (count <= 0)
+		return;
+	if (chunkSize <= 0)
+		chunkSize = 1;
+
+	// Nothing to share: run the chunks in order on this thread
+	if (workers.empty() || count <= chunkSize) {
+		for (int begin = 0; begin < count; begin += chunkSize)
+			body(begin, std::min(begin + chunkSize, count));
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->body = &body;
+		this->count = count;
+		this->chunkSize = chunkSize;
+		nextChunk.store(0);
+		busyWorkers = (int)workers.size();
+		job++;
+	}
+	wake.notify_all();
+
+	runChunks();
+
+	// Wait for the workers to finish their last chunks
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyWorkers == 0; });
+	this->body = NULL;
+}
+
+void ThreadPool::runChunks() {
+	int numChunks = (count + chunkSize - 1)/chunkSize;
+
+	for (int chunk = nextChunk.fetch_add(1); chunk < numChunks; chunk = nextChunk.fetch_add(1)) {
+		int begin = chunk*chunkSize;
+		(*body)(begin, std::min(begin + chunkSize, count));
+	}
+}
+
+void ThreadPool::workerLoop() {
+	unsigned long lastJob = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, lastJob] { return stopping || job != lastJob; });
+			if (stopping)
+				return;
+			lastJob = job;
+		}
+
+		runChunks();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --busyWorkers == 0;
+		}
+		if (last)
+			finished.notify_one();
+	}
+}
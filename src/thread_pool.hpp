@@ -0,0 +1,51 @@
+// Persistent pool of worker threads with a chunked parallel-for, used to
+// spread the per-particle work of a step across cores
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP 1
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	// Starts a pool of numThreads threads, counting the thread that calls
+	// parallelFor; 0 picks one thread per hardware thread
+	ThreadPool(int numThreads = 0);
+	~ThreadPool();
+
+	// Calls body(begin, end) on consecutive chunks of at most chunkSize items
+	// covering [0, count), spread across the pool; returns once every chunk is
+	// done. With a single thread the chunks run in order on the calling thread.
+	void parallelFor(int count, int chunkSize, const std::function<void(int, int)> &body);
+
+	int numThreads() const { return (int)workers.size() + 1; }
+
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;		// signals workers that a job started or the pool is stopping
+	std::condition_variable finished;	// signals the caller that the last worker left the job
+	unsigned long job;					// incremented for every parallelFor call
+	int busyWorkers;
+	bool stopping;
+
+	// The running job
+	const std::function<void(int, int)> *body;
+	int count;
+	int chunkSize;
+	std::atomic<int> nextChunk;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool &operator=(const ThreadPool&);
+};
+
+#endif
@@ -0,0 +1,153 @@
+// Hierarchical timing wheel that hands back items as their times come, so a
+// step only touches the items that are due instead of checking every one.
+// Level 0 has a bucket per tick for the next WHEELSLOTS ticks, and every level
+// above covers WHEELSLOTS times the span of the one below; when the ticks reach
+// a higher bucket its items are spread into the levels below.
+//
+// Items are indices into their owner's arrays, which may move them around;
+// each item's handle (kept by the owner, one per index) says where its entry
+// is, so moving or cancelling an item is O(1).
+
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP 1
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#define WHEELBITS 6
+#define WHEELSLOTS (1 << WHEELBITS)
+#define WHEELLEVELS 4				// covers WHEELSLOTS^4 ticks, 19 hours at WHEELTICK
+#define WHEELTICK (1.0/240.0)		// seconds per level 0 bucket
+
+// Where an item's entry is; bucket is -1 for items that are not scheduled
+typedef struct {
+	int bucket;
+	int slot;
+} WheelHandle;
+
+class TimingWheel {
+public:
+	TimingWheel() : tick(0) {}
+
+	// Schedules item to come due once the time passes when
+	void schedule(int item, double when, WheelHandle *handles) {
+		insert(Entry(when, item), handles);
+	}
+
+	// Forgets the item of a handle. Its entry stays in its bucket, marked, until
+	// the bucket is reached, so items can be cancelled in parallel.
+	void cancel(WheelHandle &handle) {
+		if (handle.bucket < 0)
+			return;
+		buckets[handle.bucket][handle.slot].item = -1;
+		handle.bucket = -1;
+	}
+
+	// Time an item is scheduled for
+	double when(const WheelHandle &handle) const {
+		return buckets[handle.bucket][handle.slot].when;
+	}
+
+	// Follows an item moved from one index to another; moves of different
+	// items can run in parallel
+	void move(int from, int to, WheelHandle *handles) {
+		handles[to] = handles[from];
+		if (handles[to].bucket >= 0)
+			buckets[handles[to].bucket][handles[to].slot].item = to;
+	}
+
+	// Bytes the buckets hold, counting the room they keep for more entries
+	// and the cancelled entries still waiting in them
+	long long bytes() const {
+		long long total = 0;
+		for (int index = 0; index < WHEELLEVELS*WHEELSLOTS; index++)
+			total += (long long)buckets[index].capacity()*sizeof(Entry);
+		return total;
+	}
+
+	// Calls expire(item) for every item scheduled before now, clearing its
+	// handle. Time only moves forward.
+	template<typename Expire>
+	void advance(double now, WheelHandle *handles, Expire expire) {
+		long long target = (long long)floor(now/WHEELTICK);
+
+		for (;;) {
+			std::vector<Entry> &bucket = buckets[tick & (WHEELSLOTS - 1)];
+			std::vector<Entry> later;
+			size_t kept = 0;
+			for (size_t k = 0; k < bucket.size(); k++) {
+				Entry entry = bucket[k];
+				if (entry.item < 0)
+					continue;
+				if (entry.when < now) {
+					handles[entry.item].bucket = -1;
+					expire(entry.item);
+				}
+				else if (tick < target) {
+					// Only items clamped into the top level get here
+					later.push_back(entry);
+				}
+				else {
+					bucket[kept] = entry;
+					handles[entry.item].slot = (int)kept++;
+				}
+			}
+			bucket.erase(bucket.begin() + kept, bucket.end());
+
+			if (tick >= target)
+				break;
+			tick++;
+			cascade(handles);
+			for (size_t k = 0; k < later.size(); k++)
+				insert(later[k], handles);
+		}
+	}
+
+private:
+	struct Entry {
+		Entry(double when, int item) : when(when), item(item) {}
+		double when;
+		int item;	// -1 once cancelled
+	};
+
+	void insert(const Entry &entry, WheelHandle *handles) {
+		long long due = (long long)floor(entry.when/WHEELTICK);
+		long long span = 1LL << (WHEELBITS*WHEELLEVELS);
+		due = std::max(due, tick);
+		due = std::min(due, tick + span - 1);
+
+		// The lowest level whose buckets ahead still reach the tick
+		int level = 0;
+		while (due - tick >= (1LL << (WHEELBITS*(level + 1))))
+			level++;
+
+		int index = level*WHEELSLOTS + (int)((due >> (WHEELBITS*level)) & (WHEELSLOTS - 1));
+		handles[entry.item].bucket = index;
+		handles[entry.item].slot = (int)buckets[index].size();
+		buckets[index].push_back(entry);
+	}
+
+	// Spreads the higher buckets that start at the current tick into the
+	// levels below, highest first
+	void cascade(WheelHandle *handles) {
+		int level = 1;
+		while (level < WHEELLEVELS && (tick & ((1LL << (WHEELBITS*level)) - 1)) == 0)
+			level++;
+
+		for (level--; level > 0; level--) {
+			int index = level*WHEELSLOTS + (int)((tick >> (WHEELBITS*level)) & (WHEELSLOTS - 1));
+			std::vector<Entry> entries;
+			entries.swap(buckets[index]);
+			for (size_t k = 0; k < entries.size(); k++) {
+				if (entries[k].item >= 0)
+					insert(entries[k], handles);
+			}
+		}
+	}
+
+	std::vector<Entry> buckets[WHEELLEVELS*WHEELSLOTS];
+	long long tick;		// the level 0 bucket being filled; every earlier one is done
+};
+
+#endif
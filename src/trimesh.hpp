@@ -111,7 +111,7 @@ public:
 //	Implementation
 //
 
-void TriMesh::print_details(){
+inline void TriMesh::print_details(){
 	std::cout << "Vertices: " << vertices.size() << std::endl;
 	std::cout << "Normals: " << normals.size() << std::endl;
 	std::cout << "Colors: " << colors.size() << std::endl;
@@ -119,7 +119,7 @@ void TriMesh::print_details(){
 }
 
 
-void TriMesh::need_normals( bool recompute ){
+inline void TriMesh::need_normals( bool recompute ){
 	if( vertices.size() == normals.size() && !recompute ){ return; }
 	if( normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
 	std::cout << "Computing TriMesh normals" << std::endl;
@@ -143,7 +143,7 @@ void TriMesh::need_normals( bool recompute ){
 } // end need normals
 
 
-void TriMesh::need_colors( Vec3f default_color ){
+inline void TriMesh::need_colors( Vec3f default_color ){
 	if( vertices.size() == colors.size() ){ return; }
 	else{ colors.resize( vertices.size(), default_color ); }
 } // end need colors
@@ -154,7 +154,7 @@ static void split_str( char delim, const std::string &str, std::vector<std::stri
 	while( std::getline(ss, s, delim) ){ result->push_back(s); }
 }
 
-bool TriMesh::load_obj( std::string file ){
+inline bool TriMesh::load_obj( std::string file ){
 
 	std::cout << "\nLoading " << file << std::endl;
 
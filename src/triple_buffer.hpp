@@ -0,0 +1,52 @@
+// Lock-free triple buffer for handing whole frames from one thread to another.
+// The writer fills the back buffer and publishes it; the reader takes the
+// latest published buffer whenever it likes. Neither ever waits for the
+// other: they swap buffers through one atomic exchange of the middle one.
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP 1
+
+#include <atomic>
+
+template<typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : middle(1), backIndex(0), frontIndex(2) {}
+
+	// The buffer the writer fills
+	T &back() { return buffers[backIndex]; }
+
+	// Hands the back buffer to the reader and takes the middle one to fill
+	// next. A published buffer the reader hasn't taken yet is overwritten.
+	void publish() {
+		backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Moves the reader to the latest published buffer, if there is one it
+	// hasn't taken yet, and returns whether it did
+	bool acquire() {
+		if (!pending())
+			return false;
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// The buffer the reader has, which stays put until it acquires another
+	const T &front() const { return buffers[frontIndex]; }
+
+	// Whether there is a published buffer the reader hasn't taken yet
+	bool pending() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 };
+
+	T buffers[3];
+	std::atomic<int> middle;	// index of the buffer between the two, and FRESH once published
+	int backIndex;				// only the writer touches it
+	int frontIndex;				// only the reader touches it
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer &operator=(const TripleBuffer&);
+};
+
+#endif
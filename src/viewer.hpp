@@ -0,0 +1,1276 @@
+// Based on example code from: Interactive Computer Graphics: A Top-Down Approach with Shader-Based OpenGL (6th Edition), by Ed Angel
+//
+// Shared GLFW/OpenGL front-end for the demo executables: window and input
+// handling, buffer setup and the graphics loop. The simulation itself lives
+// in the particle_core library (particle_system.hpp and scene.hpp) and runs
+// on its own thread, which hands the graphics loop snapshots of the particles.
+
+#ifndef VIEWER_HPP
+#define VIEWER_HPP 1
+
+#ifdef USE_GLEW
+    #include <GL/glew.h>
+#else
+    #define GLFW_INCLUDE_GLCOREARB
+#endif
+
+
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// This file contains the code that reads the shaders from their files and compiles them
+#include "shader.hpp"
+// This file contains helper classes and functions for rendering
+#include "helper.hpp"
+// These files contain the particle simulation and the demo scenes
+#include "particle_system.hpp"
+#include "scene.hpp"
+#include "runner.hpp"
+#include "profiler.hpp"
+#include "triple_buffer.hpp"
+
+#define BUFFER_OFFSET(bytes) ((GLvoid*) (bytes))
+
+// Persistently mapped buffers need glBufferStorage (GL 4.4 or
+// ARB_buffer_storage), which the macOS headers don't declare
+#ifdef GL_MAP_PERSISTENT_BIT
+	#define HAVE_BUFFER_STORAGE 1
+#endif
+
+#define RINGREGIONS 3	// frames of particle vertices in the persistently mapped ring
+#define RUNGAPBYTES 4096	// unchanged vertices worth sending between two changed runs to save a call
+
+// The simulation advances in fixed steps, as many as the time passed covers,
+// and the particles are drawn between the last two. A frame takes at most
+// MAXSTEPS steps; when the simulation falls further behind than that (a
+// hitch, or a high time multiplier) the rest of the time is dropped, so the
+// simulation slows down instead of taking longer and longer frames.
+#define SIMSTEP (1.0/120.0)
+#define MAXSTEPS 8
+
+#define WIN_WIDTH 800
+#define WIN_HEIGHT 800
+
+using std::cout;
+using std::endl;
+using std::min;
+using std::max;
+using std::string;
+
+
+// What the renderer needs to know of a group to lay out and draw it
+typedef struct {
+	int extent;			// see ParticleGroup::extent
+	int numRanges;		// see ParticleGroup::ranges
+	int bounds[4];
+	bool stateless;
+} GroupLayout;
+
+// A region of the persistently mapped ring that the render thread hands the
+// simulation thread to pack a snapshot's dynamic vertices into, once the GPU
+// is done with it, with where each group's slots are in it
+typedef struct {
+	int region;						// -1 for none
+	DynamicVertex *vertices;
+	long long slots[NUMFORCES];
+	long long base[NUMFORCES];
+} RingRegion;
+
+// function for the empty region: no vertices, and every slot count zero
+static RingRegion noRegion() {
+	RingRegion none = RingRegion();
+	none.region = -1;
+	return none;
+}
+
+// The particles of a frame, packed by the simulation thread for the render
+// thread. Dynamic vertices are packed whole (the ranges in use, at their
+// particles' indices), straight into a ring region when there is one they
+// fit in and into dynamics otherwise; static and spawn vertices only for the
+// runs of particles that changed since the last snapshot, one run after
+// another.
+typedef struct {
+	long long frame;		// snapshots packed before this one
+	double time;			// simulated time the particles are drawn at
+	long long numParticles;
+	GroupLayout groups[NUMFORCES];
+	int region;				// ring region the dynamic vertices are in, -1 for dynamics
+	std::vector<DynamicVertex> dynamics[NUMFORCES];
+	std::vector<int> changedRuns[NUMFORCES];
+	std::vector<StaticVertex> changedStatics[NUMFORCES];
+	std::vector<SpawnVertex> changedSpawns[NUMFORCES];
+} Snapshot;
+
+//
+//	Global state variables
+//
+namespace Globals {
+	double cursorX, cursorY; // cursor positions
+	float win_width, win_height; // window size
+	float aspect;
+	GLuint verts_vbo[1], colors_vbo[1], normals_vbo[1], faces_ibo[1], tris_vao;
+	TriMesh mesh;
+
+	//  Model, view and projection matrices, initialized to the identity
+	Mat4x4 model;
+	Mat4x4 view;
+	Mat4x4 projection;
+	
+	// Scene variables
+	Vec3f eye;
+	Vec3f view_dir;
+	Mat4x4 x_rot;
+	Mat4x4 y_rot;
+	Vec3f up_dir;
+	Vec3f right_dir;
+	
+	// Input variables
+	bool key_up; // forward movement
+	bool key_w;
+	bool key_down; // backward movement
+	bool key_s;
+	bool key_right; // right strafing
+	bool key_d;
+	bool key_left; // left strafing
+	bool key_a;
+	bool key_rshift; // upward movement
+	bool key_e;
+	bool key_0; // downward movement
+	bool key_q;
+	bool key_rcontrol; // speed up
+	bool key_lshift; 
+	
+	double theta;
+	double phi;
+}
+
+// Function to construct viewing transformation matrix
+void generateViewing() {
+	// Calculate the orthogonal axes based on the viewing parameters
+	Vec3f n = Globals::view_dir * (-1.f/Globals::view_dir.len());
+	Vec3f u = Globals::up_dir.cross(n);
+	u.normalize();
+	Vec3f v = n.cross(u);
+	
+	// Calculate the translation based on the new axes
+	float dx = -(Globals::eye.dot(u));
+	float dy = -(Globals::eye.dot(v));
+	float dz = -(Globals::eye.dot(n));
+	
+	// Fill in the matrix
+	Globals::view.m[0] = u[0];	Globals::view.m[4] = u[1];	Globals::view.m[8] = u[2];	Globals::view.m[12] = dx;
+	Globals::view.m[1] = v[0];	Globals::view.m[5] = v[1];	Globals::view.m[9] = v[2];	Globals::view.m[13] = dy;
+	Globals::view.m[2] = n[0];	Globals::view.m[6] = n[1];	Globals::view.m[10] = n[2];	Globals::view.m[14] = dz;
+	Globals::view.m[3] = 0;		Globals::view.m[7] = 0;		Globals::view.m[11] = 0;	Globals::view.m[15] = 1;
+}
+
+// Function to construct perspective projection transformation matrix
+void generateProjection(float left, float bottom, float right, float top, float near, float far) {
+	Globals::projection.m[0] = 2*near/(right-left);			Globals::projection.m[4] = 0;					
+	Globals::projection.m[1] = 0;							Globals::projection.m[5] = 2*near/(top-bottom);
+	Globals::projection.m[2] = 0;							Globals::projection.m[6] = 0;
+	Globals::projection.m[3] = 0;							Globals::projection.m[7] = 0;
+	
+	Globals::projection.m[8] = (right+left)/(right-left);	Globals::projection.m[12] = 0;
+	Globals::projection.m[9] = (top+bottom)/(top-bottom);	Globals::projection.m[13] = 0;
+	Globals::projection.m[10] = -(far+near)/(far-near);		Globals::projection.m[14] = -2*far*near/(far-near);
+	Globals::projection.m[11] = -1;							Globals::projection.m[15] = 0;
+}
+
+
+//----------------------------------------------------------------------------
+
+// initialize some basic structures and geometry
+typedef struct {
+	bool active = false;
+	GLdouble prev_x;
+	GLdouble prev_y;
+} MouseInfo;
+
+// some assorted global variables, defined as such to make life easier
+GLuint 	vao,
+		vbo_particles,	// dynamic vertices, streamed every frame
+		vbo_statics,	// static vertices, updated only where they change
+		vao_stateless,
+		vbo_spawns,		// spawn vertices of stateless groups, updated like static ones
+		vao_ground,
+		vbo_ground;
+
+// Every group has its own run of slots in the particle buffers, at the same
+// vertex index in the dynamic and static ones (or in the spawn buffer for
+// stateless groups), so one group's static vertices stay put while the
+// others grow and shrink. A group's slots grow geometrically.
+long long groupSlots[NUMFORCES] = {};
+long long groupBase[NUMFORCES] = {};
+long long bufferCapacity = 0;	// slots over streamed groups (per ring region when mapped persistently)
+
+// Copies of every group's static or spawn vertices as on the GPU, which the
+// changed runs of every snapshot are copied into and sent from
+std::vector<StaticVertex> staticVertices[NUMFORCES];
+std::vector<SpawnVertex> spawnVertices[NUMFORCES];
+bool resendVertices = false;	// the buffers were laid out anew, so every copy goes up again
+
+// The simulation thread packs snapshots into the back of the triple buffer
+// while the render thread draws the front one. The render thread asks for a
+// frame once it has taken the last one, so the simulation runs at most one
+// snapshot ahead and none is skipped (their changed runs would be lost).
+TripleBuffer<Snapshot> snapshots;
+std::vector<StaticVertex> packedStatics[NUMFORCES];	// what packStatic fills on the simulation thread
+std::vector<SpawnVertex> packedSpawns[NUMFORCES];
+
+// Requests from the render thread to the simulation thread
+std::mutex simulationMutex;
+std::condition_variable simulationWake;
+bool frameWanted = false;		// pack another snapshot
+double timeWanted = 0.0;		// after simulating this many more seconds
+RingRegion regionWanted = noRegion();	// into this ring region
+bool simulationStopping = false;
+
+Profiler *profiler = NULL;
+
+// Dynamic vertices end up in GPU-visible memory. With persistent mapping the
+// buffer is a ring of RINGREGIONS regions, and a fence per region keeps the
+// simulation from writing one the GPU still reads; the simulation thread
+// packs into a region itself. Otherwise the buffer is orphaned and mapped
+// anew every frame, and the render thread copies the snapshot's vertices in.
+bool persistentUpload = false;
+DynamicVertex *ringVertices = NULL;
+GLsync ringFences[RINGREGIONS] = {};
+int ringRegion = 0;		// region holding the vertices drawn this frame
+
+// Bytes of particle vertices sent to the GPU in the last frame
+long long uploadedBytes = 0;
+
+Vec3f 	lightDir = {1, -1, 1},
+		lightAmb = {.2, .2, .2},
+		lightCol = {1.0, 1.0, 1.0};
+
+mcl::Shader currentShader;
+
+MouseInfo mouse;
+bool paused = false, addTimeMultiplier = false, subTimeMultiplier = false;
+double timeMultiplier = 1.0;
+
+GLFWcursor *hand_cursor, *arrow_cursor;
+
+//----------------------------------------------------------------------------
+// function that is called whenever an error occurs
+static void
+error_callback(int error, const char* description){
+    fputs(description, stderr);  // write the error description to stderr
+}
+
+//----------------------------------------------------------------------------
+// function that is called whenever a keyboard event occurs; defines how keyboard input will be handled
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods){
+	if( action == GLFW_PRESS ) {
+		switch ( key ) {
+			// Close on escape
+			case GLFW_KEY_ESCAPE: glfwSetWindowShouldClose(window, GL_TRUE); break;
+
+			// Movement keys trigger booleans to be processed during the graphics loop
+			// Forward movement
+			case GLFW_KEY_UP: Globals::key_up = true; break;
+			case GLFW_KEY_W: Globals::key_w = true; break;
+
+			// Backward movement
+			case GLFW_KEY_DOWN: Globals::key_down = true; break;
+			case GLFW_KEY_S: Globals::key_s = true; break;
+
+			// Right strafing movement
+			case GLFW_KEY_RIGHT: Globals::key_right = true; break;
+			case GLFW_KEY_D: Globals::key_d = true; break;
+
+			// Left strafing movement
+			case GLFW_KEY_LEFT: Globals::key_left = true; break;
+			case GLFW_KEY_A: Globals::key_a = true; break;
+
+			// Upward movement
+			case GLFW_KEY_RIGHT_SHIFT: Globals::key_rshift = true; break;
+			case GLFW_KEY_E: Globals::key_e = true; break;
+
+			// Downward movement
+			case GLFW_KEY_KP_0: Globals::key_0 = true; break;
+			case GLFW_KEY_Q: Globals::key_q = true; break;
+
+			// Speed up
+			case GLFW_KEY_RIGHT_CONTROL: Globals::key_rcontrol = true; break;
+			case GLFW_KEY_LEFT_SHIFT: Globals::key_lshift = true; break;
+
+			// Pause
+			case GLFW_KEY_SPACE: paused = !paused; break;
+
+			// Release mouse
+			case GLFW_KEY_KP_ENTER: glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL); break;
+
+			// Increase/decrease game speed
+			case GLFW_KEY_MINUS: subTimeMultiplier = true; break;
+			case GLFW_KEY_EQUAL: addTimeMultiplier = true; break;
+			case GLFW_KEY_BACKSPACE: timeMultiplier = 1.0; 
+			
+		}
+	}
+	else if ( action == GLFW_RELEASE ) {
+		switch ( key ) {
+			// Movement keys trigger booleans to be processed during the graphics loop
+			// Forward movement
+			case GLFW_KEY_UP: Globals::key_up = false; break;
+			case GLFW_KEY_W: Globals::key_w = false; break;
+
+			// Backward movement
+			case GLFW_KEY_DOWN: Globals::key_down = false; break;
+			case GLFW_KEY_S: Globals::key_s = false; break;
+
+			// Right strafing movement
+			case GLFW_KEY_RIGHT: Globals::key_right = false; break;
+			case GLFW_KEY_D: Globals::key_d = false; break;
+
+			// Left strafing movement
+			case GLFW_KEY_LEFT: Globals::key_left = false; break;
+			case GLFW_KEY_A: Globals::key_a = false; break;
+
+			// Upward movement
+			case GLFW_KEY_RIGHT_SHIFT: Globals::key_rshift = false; break;
+			case GLFW_KEY_E: Globals::key_e = false; break;
+
+			// Downward movement
+			case GLFW_KEY_KP_0: Globals::key_0 = false; break;
+			case GLFW_KEY_Q: Globals::key_q = false; break;
+
+			// Speed up
+			case GLFW_KEY_RIGHT_CONTROL: Globals::key_rcontrol = false; break;
+			case GLFW_KEY_LEFT_SHIFT: Globals::key_lshift = false; break;
+
+			// Increase/decrease game speed
+			case GLFW_KEY_MINUS: subTimeMultiplier = false; break;
+			case GLFW_KEY_EQUAL: addTimeMultiplier = false;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// function that is called whenever a mouse or trackpad button press event occurs
+static void
+mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwGetCursorPos(window, &mouse.prev_x, &mouse.prev_y);
+		mouse.active = true;
+	}
+}
+
+//----------------------------------------------------------------------------
+// function that is called whenever a cursor motion event occurs
+static void
+cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
+	if (!mouse.active)
+		return;
+
+	Vec3f view_dir = Vec3f(0.0, 0.0, 1.0);
+	Vec3f up_dir = Vec3f(0.0, 1.0, 0.0);
+	
+	if (xpos != mouse.prev_x) {	
+		Globals::theta -= 0.2*(xpos - mouse.prev_x);
+		Globals::y_rot = rotateY(Globals::theta);
+		mouse.prev_x = xpos;
+		glUniform1f(currentShader.uniform("theta"), Globals::theta*PI/180.0);
+	}
+
+	if (ypos != mouse.prev_y) {
+		Globals::phi += 0.2*(ypos - mouse.prev_y);
+		if (Globals::phi > 89)
+			Globals::phi = 89;
+		else if (Globals::phi < -89)
+			Globals::phi = -89;
+		Globals::x_rot = rotateX(Globals::phi);
+		mouse.prev_y = ypos;
+		glUniform1f(currentShader.uniform("phi"), Globals::phi*PI/180.0);
+	}
+	
+	view_dir = Globals::x_rot*view_dir;
+	Globals::view_dir = Globals::y_rot*view_dir;
+
+	up_dir = Globals::x_rot*up_dir;
+	Globals::up_dir = Globals::y_rot*up_dir;
+
+	Globals::right_dir = Globals::up_dir.cross(Globals::view_dir);;
+}
+
+//----------------------------------------------------------------------------
+// functions for pointing the shader's inputs at the dynamic or static
+// vertices starting at offset in the bound buffer. Colors, blurs and lightings
+// are normalized bytes and sizes normalized shorts (fractions of MAXSIZE), as
+// the particles store them.
+static void setDynamicLayout( mcl::Shader &shader, GLintptr offset ) {
+	GLsizei stride = sizeof(DynamicVertex);
+
+    glEnableVertexAttribArray( shader.attribute("vertex_position") );
+    glVertexAttribPointer( shader.attribute("vertex_position"), 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offset + offsetof(DynamicVertex, position)) );
+
+    glEnableVertexAttribArray( shader.attribute("vertex_color") );
+    glVertexAttribPointer( shader.attribute("vertex_color"), 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(DynamicVertex, color)) );
+}
+
+static void setStaticLayout( mcl::Shader &shader, GLintptr offset ) {
+	GLsizei stride = sizeof(StaticVertex);
+
+	glEnableVertexAttribArray( shader.attribute("particle_size") );
+	glVertexAttribPointer( shader.attribute("particle_size"), 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(StaticVertex, size)) );
+
+	// Blur and lighting are one byte pair
+	glEnableVertexAttribArray( shader.attribute("particle_blur_lighting") );
+	glVertexAttribPointer( shader.attribute("particle_blur_lighting"), 2, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(StaticVertex, blur)) );
+}
+
+// Spawn vertices feed the same inputs, with the position and color at spawn,
+// plus what the shader needs to move and fade them
+static void setSpawnLayout( mcl::Shader &shader, GLintptr offset ) {
+	GLsizei stride = sizeof(SpawnVertex);
+
+    glEnableVertexAttribArray( shader.attribute("vertex_position") );
+    glVertexAttribPointer( shader.attribute("vertex_position"), 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, position)) );
+
+    glEnableVertexAttribArray( shader.attribute("vertex_color") );
+    glVertexAttribPointer( shader.attribute("vertex_color"), 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, colorStart)) );
+
+	glEnableVertexAttribArray( shader.attribute("particle_size") );
+	glVertexAttribPointer( shader.attribute("particle_size"), 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, size)) );
+
+	glEnableVertexAttribArray( shader.attribute("particle_blur_lighting") );
+	glVertexAttribPointer( shader.attribute("particle_blur_lighting"), 2, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, blur)) );
+
+	glEnableVertexAttribArray( shader.attribute("spawn_velocity") );
+	glVertexAttribPointer( shader.attribute("spawn_velocity"), 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, velocity)) );
+
+	glEnableVertexAttribArray( shader.attribute("spawn_color_end") );
+	glVertexAttribPointer( shader.attribute("spawn_color_end"), 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, colorEnd)) );
+
+	// Birth, aging rate and color speed are three floats in a row
+	glEnableVertexAttribArray( shader.attribute("spawn_times") );
+	glVertexAttribPointer( shader.attribute("spawn_times"), 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offset + offsetof(SpawnVertex, birth)) );
+}
+
+// function for checking whether the context can map buffers persistently
+static bool bufferStorageSupported() {
+#ifdef HAVE_BUFFER_STORAGE
+	GLint major = 0, minor = 0;
+	glGetIntegerv( GL_MAJOR_VERSION, &major );
+	glGetIntegerv( GL_MINOR_VERSION, &minor );
+	if (major > 4 || (major == 4 && minor >= 4))
+		return true;
+
+	GLint count = 0;
+	glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+	for (GLint i = 0; i < count; i++)
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0)
+			return true;
+#endif
+	return false;
+}
+
+// function for waiting until the GPU is done drawing from a ring region
+static void waitForRegion(int region) {
+	if (!ringFences[region])
+		return;
+
+	GLenum status;
+	do {
+		status = glClientWaitSync( ringFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 );
+	} while (status == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync( ringFences[region] );
+	ringFences[region] = 0;
+}
+
+// function for handing the simulation thread the region after the one drawn
+// now, once the GPU is done with it. Snapshots are drawn in the order they
+// are asked for, so that region was drawn longest ago.
+static RingRegion nextRegion() {
+	RingRegion next = noRegion();
+	if (!persistentUpload || !ringVertices)
+		return next;
+
+	next.region = (ringRegion + 1) % RINGREGIONS;
+	waitForRegion(next.region);
+	next.vertices = ringVertices + next.region*bufferCapacity;
+	for (int force = 0; force < NUMFORCES; force++) {
+		next.slots[force] = groupSlots[force];
+		next.base[force] = groupBase[force];
+	}
+	return next;
+}
+
+// function for marking the region drawn this frame busy until the GPU is done
+static void fenceRegion() {
+	if (!persistentUpload)
+		return;
+
+	if (ringFences[ringRegion])
+		glDeleteSync( ringFences[ringRegion] );
+	ringFences[ringRegion] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+// function for making sure every group has a slot for each index its
+// particles can be at (see ParticleGroup::extent).
+// When one runs out, its slots double and the buffers are laid out again;
+// dynamic vertices are copied anew every frame and static ones are all sent
+// again from their copies, so nothing is copied over on the GPU.
+static void reserveParticleBuffers(const Snapshot &snapshot, mcl::Shader &shader) {
+	bool grown = false;
+	for (int force = 0; force < NUMFORCES; force++) {
+		long long count = snapshot.groups[force].extent;
+		if (count > groupSlots[force] || groupSlots[force] == 0) {
+			groupSlots[force] = max(2*groupSlots[force], 1024LL);
+			while (groupSlots[force] < count)
+				groupSlots[force] *= 2;
+			grown = true;
+		}
+	}
+	if (!grown)
+		return;
+
+	long long capacity = 0, spawnCapacity = 0;
+	for (int force = 0; force < NUMFORCES; force++) {
+		bool stateless = snapshot.groups[force].stateless;
+		long long &slots = stateless ? spawnCapacity : capacity;
+		groupBase[force] = slots;
+		slots += groupSlots[force];
+
+		if (stateless)
+			spawnVertices[force].resize(groupSlots[force]);
+		else
+			staticVertices[force].resize(groupSlots[force]);
+	}
+	resendVertices = true;
+
+	if (persistentUpload) {
+#ifdef HAVE_BUFFER_STORAGE
+		// Persistent storage can't be resized, so the ring moves to a new
+		// buffer; the old one lives on until the GPU is done with it
+		if (ringVertices) {
+			glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+			glUnmapBuffer( GL_ARRAY_BUFFER );
+			glDeleteBuffers( 1, &vbo_particles );
+		}
+		for (int r = 0; r < RINGREGIONS; r++) {
+			if (ringFences[r])
+				glDeleteSync( ringFences[r] );
+			ringFences[r] = 0;
+		}
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr bytes = sizeof(DynamicVertex)*capacity*RINGREGIONS;
+		glGenBuffers( 1, &vbo_particles );
+		glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+		glBufferStorage( GL_ARRAY_BUFFER, bytes, NULL, flags );
+		ringVertices = (DynamicVertex*)glMapBufferRange( GL_ARRAY_BUFFER, 0, bytes, flags );
+		ringRegion = 0;
+#endif
+	}
+	else {
+		glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+		glBufferData( GL_ARRAY_BUFFER, sizeof(DynamicVertex)*capacity, NULL, GL_STREAM_DRAW );
+	}
+
+	glBindBuffer( GL_ARRAY_BUFFER, vbo_statics );
+	glBufferData( GL_ARRAY_BUFFER, sizeof(StaticVertex)*capacity, NULL, GL_DYNAMIC_DRAW );
+
+	glBindBuffer( GL_ARRAY_BUFFER, vbo_spawns );
+	glBufferData( GL_ARRAY_BUFFER, sizeof(SpawnVertex)*spawnCapacity, NULL, GL_DYNAMIC_DRAW );
+
+	// The vertex array objects hold on to the buffers they were set up with
+	glBindVertexArray( vao_stateless );
+	setSpawnLayout( shader, 0 );
+
+	glBindVertexArray( vao );
+	glBindBuffer( GL_ARRAY_BUFFER, vbo_statics );
+	setStaticLayout( shader, 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+	setDynamicLayout( shader, 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	bufferCapacity = capacity;
+}
+
+// function for sending the runs of changed vertices in a group's copy to
+// the group's slots in the bound buffer, merging runs that are close
+// together; returns the bytes sent
+template<typename Vertex>
+static long long uploadRuns(const std::vector<int> &runs, const std::vector<Vertex> &vertices, long long base) {
+	long long bytes = 0;
+	size_t run = 0;
+	while (run < runs.size()) {
+		int begin = runs[run], end = runs[run + 1];
+		for (run += 2; run < runs.size() && sizeof(Vertex)*(runs[run] - end) <= RUNGAPBYTES; run += 2)
+			end = runs[run + 1];
+
+		glBufferSubData( GL_ARRAY_BUFFER, sizeof(Vertex)*(base + begin), sizeof(Vertex)*(end - begin), &vertices[begin] );
+		bytes += sizeof(Vertex)*(end - begin);
+	}
+	return bytes;
+}
+
+// functions for moving the changed runs of a group's vertices between its
+// full copy and a snapshot, where they follow one another
+template<typename Vertex>
+static void gatherRuns(const std::vector<int> &runs, const std::vector<Vertex> &vertices, std::vector<Vertex> &changed) {
+	for (size_t run = 0; run < runs.size(); run += 2)
+		changed.insert(changed.end(), vertices.begin() + runs[run], vertices.begin() + runs[run + 1]);
+}
+
+template<typename Vertex>
+static void scatterRuns(const std::vector<int> &runs, const std::vector<Vertex> &changed, std::vector<Vertex> &vertices) {
+	size_t next = 0;
+	for (size_t run = 0; run < runs.size(); run += 2) {
+		int count = runs[run + 1] - runs[run];
+		std::copy(changed.begin() + next, changed.begin() + next + count, vertices.begin() + runs[run]);
+		next += count;
+	}
+}
+
+// function for packing the particles into a snapshot on the simulation
+// thread, placed blend of the way through the last step. Dynamic vertices go
+// straight into the ring region if every group fits its slots there; when
+// one has outgrown them the render thread lays the buffers out anew, which
+// drops the region, so they are packed into the snapshot to be copied.
+static void packSnapshot(ParticleSystem &system, Snapshot &snapshot, float blend, const RingRegion &region) {
+	snapshot.time = system.time - (1.0 - blend)*SIMSTEP;
+	snapshot.numParticles = system.numParticles;
+
+	snapshot.region = region.region;
+	for (int force = 0; force < NUMFORCES && snapshot.region >= 0; force++) {
+		if (system.groups[force].extent() > region.slots[force])
+			snapshot.region = -1;
+	}
+
+	for (int force = 0; force < NUMFORCES; force++) {
+		const ParticleGroup &group = system.groups[force];
+		GroupLayout &layout = snapshot.groups[force];
+		layout.extent = group.extent();
+		layout.numRanges = group.ranges(layout.bounds);
+		layout.stateless = group.stateless;
+
+		std::vector<int> &runs = snapshot.changedRuns[force];
+		runs.clear();
+		snapshot.changedStatics[force].clear();
+		snapshot.changedSpawns[force].clear();
+
+		if (group.stateless) {
+			if ((int)packedSpawns[force].size() < layout.extent)
+				packedSpawns[force].resize(layout.extent);
+			system.packSpawns(force, packedSpawns[force].data(), runs);
+			gatherRuns(runs, packedSpawns[force], snapshot.changedSpawns[force]);
+		}
+		else {
+			if (snapshot.region >= 0) {
+				snapshot.dynamics[force].clear();
+				system.packDynamic(force, region.vertices + region.base[force], blend);
+			}
+			else {
+				snapshot.dynamics[force].resize(layout.extent);
+				system.packDynamic(force, snapshot.dynamics[force].data(), blend);
+			}
+
+			if ((int)packedStatics[force].size() < layout.extent)
+				packedStatics[force].resize(layout.extent);
+			system.packStatic(force, packedStatics[force].data(), runs);
+			gatherRuns(runs, packedStatics[force], snapshot.changedStatics[force]);
+		}
+	}
+}
+
+// function for sending a snapshot to the GPU. Dynamic vertices the simulation
+// packed into a ring region are drawn from there; otherwise they are copied
+// straight into GPU-visible memory. Static and spawn vertices only go up
+// for the particles that spawned or moved (or all of a group whose force
+// changes sizes), so stateless groups send nothing else.
+static void streamParticles(const Snapshot &snapshot, mcl::Shader &shader) {
+	reserveParticleBuffers(snapshot, shader);
+	uploadedBytes = 0;
+
+	DynamicVertex *dynamics = NULL;
+	if (snapshot.region >= 0) {
+		// Already in place; the region's vertices count as this frame's upload
+		ringRegion = snapshot.region;
+		glBindVertexArray( vao );
+		glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+		setDynamicLayout( shader, sizeof(DynamicVertex)*ringRegion*bufferCapacity );
+
+		for (int force = 0; force < NUMFORCES; force++) {
+			const GroupLayout &layout = snapshot.groups[force];
+			if (layout.stateless)
+				continue;
+			for (int range = 0; range < layout.numRanges; range++)
+				uploadedBytes += sizeof(DynamicVertex)*(layout.bounds[2*range + 1] - layout.bounds[2*range]);
+		}
+	}
+	else if (persistentUpload) {
+		// The buffers were just laid out anew (or this is the first snapshot):
+		// move to the ring region drawn longest ago, once the GPU is done
+		// with it, and copy the vertices there
+		ringRegion = (ringRegion + 1) % RINGREGIONS;
+		waitForRegion(ringRegion);
+		dynamics = ringVertices + ringRegion*bufferCapacity;
+
+		glBindVertexArray( vao );
+		glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+		setDynamicLayout( shader, sizeof(DynamicVertex)*ringRegion*bufferCapacity );
+	}
+	else {
+		// Orphan the old storage, so the driver hands out fresh memory instead
+		// of waiting for the GPU to finish the last frame's draws
+		glBindBuffer( GL_ARRAY_BUFFER, vbo_particles );
+		glBufferData( GL_ARRAY_BUFFER, sizeof(DynamicVertex)*bufferCapacity, NULL, GL_STREAM_DRAW );
+		dynamics = (DynamicVertex*)glMapBufferRange( GL_ARRAY_BUFFER, 0, sizeof(DynamicVertex)*bufferCapacity,
+													 GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+	}
+
+	if (dynamics) {
+		for (int force = 0; force < NUMFORCES; force++) {
+			const GroupLayout &layout = snapshot.groups[force];
+			if (layout.stateless)
+				continue;
+			for (int range = 0; range < layout.numRanges; range++) {
+				int begin = layout.bounds[2*range], count = layout.bounds[2*range + 1] - begin;
+				memcpy(dynamics + groupBase[force] + begin, &snapshot.dynamics[force][begin], sizeof(DynamicVertex)*count);
+				uploadedBytes += sizeof(DynamicVertex)*count;
+			}
+		}
+	}
+	if (!persistentUpload && dynamics)
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+
+	std::vector<int> everything(2);
+	for (int force = 0; force < NUMFORCES; force++) {
+		const GroupLayout &layout = snapshot.groups[force];
+		const std::vector<int> &runs = snapshot.changedRuns[force];
+		everything[1] = layout.extent;
+
+		if (layout.stateless) {
+			scatterRuns(runs, snapshot.changedSpawns[force], spawnVertices[force]);
+			glBindBuffer( GL_ARRAY_BUFFER, vbo_spawns );
+			uploadedBytes += uploadRuns(resendVertices ? everything : runs, spawnVertices[force], groupBase[force]);
+		}
+		else {
+			scatterRuns(runs, snapshot.changedStatics[force], staticVertices[force]);
+			glBindBuffer( GL_ARRAY_BUFFER, vbo_statics );
+			uploadedBytes += uploadRuns(resendVertices ? everything : runs, staticVertices[force], groupBase[force]);
+		}
+	}
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	resendVertices = false;
+}
+
+// function for finding the slot of the first particle, which is drawn on its
+// own before the ground (see the rendering step)
+static GLint firstParticle(const Snapshot &snapshot) {
+	for (int force = 0; force < NUMFORCES; force++) {
+		const GroupLayout &layout = snapshot.groups[force];
+		if (!layout.stateless && layout.numRanges > 0)
+			return (GLint)(groupBase[force] + layout.bounds[0]);
+	}
+	return 0;
+}
+
+// function for drawing every particle but the first, one range per streamed
+// group (two for a ring that wraps around), then the stateless groups with the
+// shader evaluating their force. Empty groups are left out; some drivers
+// (Mesa's llvmpipe) drop the whole call when a range is empty. Each call is
+// timed while tracing or counting, which covers issuing it, not the GPU's
+// work.
+static void drawParticles(const Snapshot &snapshot, mcl::Shader &shader, long long frame) {
+	Profiler *callProfiler = detailed(profiler);
+	glBindVertexArray( vao_stateless );
+	for (int force = 0; force < NUMFORCES; force++) {
+		const GroupLayout &layout = snapshot.groups[force];
+		if (!layout.stateless)
+			continue;
+		glUniform1i( shader.uniform("evaluatedForce"), force );
+		for (int range = 0; range < layout.numRanges; range++) {
+			int count = layout.bounds[2*range + 1] - layout.bounds[2*range];
+			ProfileTimer timer(callProfiler, PHASE_DRAWCALL, frame, count);
+			glDrawArrays( GL_POINTS, (GLint)(groupBase[force] + layout.bounds[2*range]), count );
+		}
+	}
+	glUniform1i( shader.uniform("evaluatedForce"), 0 );
+	glBindVertexArray( vao );
+
+	GLint firsts[2*NUMFORCES];
+	GLsizei counts[2*NUMFORCES];
+	int ranges = 0;
+	long long total = 0;
+	for (int force = 0; force < NUMFORCES; force++) {
+		const GroupLayout &layout = snapshot.groups[force];
+		if (layout.stateless)
+			continue;
+		for (int range = 0; range < layout.numRanges; range++) {
+			firsts[ranges] = (GLint)(groupBase[force] + layout.bounds[2*range]);
+			counts[ranges] = layout.bounds[2*range + 1] - layout.bounds[2*range];
+			total += counts[ranges];
+			ranges++;
+		}
+	}
+	if (ranges == 0)
+		return;
+
+	firsts[0]++;
+	counts[0]--;
+	ProfileTimer timer(callProfiler, PHASE_DRAWCALL, frame, total - 1);
+	if (counts[0] > 0)
+		glMultiDrawArrays( GL_POINTS, firsts, counts, ranges );
+	else if (ranges > 1)
+		glMultiDrawArrays( GL_POINTS, firsts + 1, counts + 1, ranges - 1 );
+}
+
+//----------------------------------------------------------------------------
+// Simulation thread: steps the scene in fixed steps over the time the render
+// thread hands it with each frame it asks for, then packs a snapshot. It
+// starts on a frame as soon as the render thread has taken the last, so the
+// simulation of one frame overlaps the upload, drawing and swap of the one
+// before.
+
+static void simulate(ParticleSystem *system, Scene *scene, Random stream) {
+	// Carry on the scene's random numbers from where its setup left them
+	threadRandom() = stream;
+
+	double accumulator = 0;	// simulated seconds still to step
+	long long frame = 1;	// the first snapshot is packed before the thread starts
+	if (profiler)
+		profiler->nameThread("simulation");
+
+	for (;;) {
+		RingRegion region;
+		{
+			std::unique_lock<std::mutex> lock(simulationMutex);
+			simulationWake.wait(lock, []{ return frameWanted || simulationStopping; });
+			if (simulationStopping)
+				return;
+			frameWanted = false;
+			accumulator += timeWanted;
+			timeWanted = 0.0;
+			region = regionWanted;
+		}
+
+		int steps;
+		for (steps = 0; steps < MAXSTEPS && accumulator >= SIMSTEP; steps++) {
+			// Move the emitters and spawn new particles
+			scene->spawn(*system, SIMSTEP);
+
+			// Update every particle
+			system->update(SIMSTEP);
+
+			accumulator -= SIMSTEP;
+		}
+		if (steps == MAXSTEPS)
+			accumulator = min(accumulator, SIMSTEP);
+
+		ProfileTimer timer(profiler, PHASE_PACK, frame, system->numParticles);
+		Snapshot &snapshot = snapshots.back();
+		snapshot.frame = frame++;
+		packSnapshot(*system, snapshot, (float)(accumulator/SIMSTEP), region);
+		snapshots.publish();
+	}
+}
+
+// functions for the render thread to ask the simulation thread for a frame
+// covering time more seconds, and to stop it. Neither waits on the
+// simulation: the lock only guards the request. Asking may wait on the GPU
+// for the ring region the frame goes into.
+static void requestFrame(double time) {
+	RingRegion region = nextRegion();
+	{
+		std::lock_guard<std::mutex> lock(simulationMutex);
+		frameWanted = true;
+		timeWanted += time;
+		regionWanted = region;
+	}
+	simulationWake.notify_one();
+}
+
+static void stopSimulation() {
+	{
+		std::lock_guard<std::mutex> lock(simulationMutex);
+		simulationStopping = true;
+	}
+	simulationWake.notify_one();
+}
+
+//----------------------------------------------------------------------------
+
+void init( mcl::Shader shader ) {
+	// Initalize all other scene elements (meshes, etc.). The ground plane is
+	// unlit, unblurred and drawn as triangles, so only position and color matter.
+	DynamicVertex mesh_verts[4];
+	StaticVertex mesh_statics[4];
+	memset(mesh_statics, 0, sizeof(mesh_statics));
+	mesh_verts[0].position = Vec3f(-100, 0, 0);
+	mesh_verts[1].position = Vec3f(-100, 0, 200);
+	mesh_verts[2].position = Vec3f(100, 0, 200);
+	mesh_verts[3].position = Vec3f(100, 0, 0);
+
+	mesh_verts[0].color[0] = 51; mesh_verts[0].color[1] = 0; mesh_verts[0].color[2] = 0; mesh_verts[0].color[3] = 255;
+	mesh_verts[1].color[0] = 0; mesh_verts[1].color[1] = 51; mesh_verts[1].color[2] = 0; mesh_verts[1].color[3] = 255;
+	mesh_verts[2].color[0] = 0; mesh_verts[2].color[1] = 0; mesh_verts[2].color[2] = 51; mesh_verts[2].color[3] = 255;
+	mesh_verts[3].color[0] = 0; mesh_verts[3].color[1] = 51; mesh_verts[3].color[2] = 51; mesh_verts[3].color[3] = 255;
+
+    // Create the buffer for the ground plane, which has its own vertex array
+	// object so the particle buffer can grow
+	glGenBuffers( 1, &vbo_ground );
+	glBindBuffer( GL_ARRAY_BUFFER, vbo_ground );
+	glBufferData( GL_ARRAY_BUFFER, sizeof(mesh_verts) + sizeof(mesh_statics), NULL, GL_STATIC_DRAW );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(mesh_verts), mesh_verts );
+	glBufferSubData( GL_ARRAY_BUFFER, sizeof(mesh_verts), sizeof(mesh_statics), mesh_statics );
+
+	glGenVertexArrays( 1, &vao_ground );
+	glBindVertexArray( vao_ground );
+	setDynamicLayout( shader, 0 );
+	setStaticLayout( shader, sizeof(mesh_verts) );
+
+    // Create the vertex array object and the buffers for the particles'
+	// vertices, which get room for the particles with the first snapshot
+    glGenVertexArrays( 1, &vao );
+	glGenVertexArrays( 1, &vao_stateless );
+	glGenBuffers( 1, &vbo_particles );
+	glGenBuffers( 1, &vbo_statics );
+	glGenBuffers( 1, &vbo_spawns );
+
+    // Define static OpenGL state variables
+	glEnable(GL_POINT_SPRITE);
+	glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+	glClearDepth(1.0);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    // Define some GLFW cursors (in case you want to dynamically change the cursor's appearance)
+    // If you want, you can add more cursors, and even define your own cursor appearance
+    arrow_cursor = glfwCreateStandardCursor(GLFW_ARROW_CURSOR);
+    hand_cursor = glfwCreateStandardCursor(GLFW_HAND_CURSOR);
+    
+}
+
+//----------------------------------------------------------------------------
+// Opens a window and runs the scene until the window is closed
+
+int runViewer(const RunOptions &options) {
+
+	GLFWwindow* window;
+
+	// Seed before creating the scene, which draws random numbers as it sets up
+	ParticleSystem system(options.maxParticles);
+	system.setThreads(options.threads, options.chunkSize);
+	system.setSeed(options.seed);
+	system.setStateless(options.stateless);
+
+	Scene *scene = createScene(options.scene);
+	if (!scene) {
+		cout << "unknown scene: " << options.scene << endl;
+		return EXIT_FAILURE;
+	}
+	
+
+	// ------------ OpenGL setup -----------------
+
+    // Define the error callback function
+    glfwSetErrorCallback(error_callback);
+    
+    // Initialize GLFW (performs platform-specific initialization)
+    if (!glfwInit()) exit(EXIT_FAILURE);
+    
+    // Ask for OpenGL 3.2
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    // Use GLFW to open a window within which to display your graphics
+	Globals::win_width = WIN_WIDTH;
+	Globals::win_height = WIN_HEIGHT;
+	window = glfwCreateWindow((int)Globals::win_width, (int)Globals::win_height, "Particle Test", NULL, NULL);
+	
+    // Verify that the window was successfully created; if not, print error message and terminate
+    if (!window)
+	{
+        printf("GLFW failed to create window; terminating\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+	}
+    
+	glfwMakeContextCurrent(window); // makes the newly-created context current
+    
+	glfwSwapInterval(1);  // tells the system to wait to swap buffers until monitor refresh has completed; necessary to avoid tearing
+
+    // Define the keyboard callback function
+    glfwSetKeyCallback(window, key_callback);
+    // Define the mouse button callback function
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    // Define the mouse motion callback function
+    glfwSetCursorPosCallback(window, cursor_pos_callback);
+
+    // If not using a Mac, initialize GLEW
+    #ifdef USE_GLEW
+        glewExperimental = GL_TRUE;
+        GLenum err = glewInit();
+        // check for errors in GLEW initialization
+        if (err != GLEW_OK) {
+            cout << "error initializing GLEW: " << glewGetErrorString(err) << endl;
+            exit(EXIT_FAILURE);
+        }
+    #endif
+
+
+	// ------------ Shader setup -----------------
+
+	// Create the shaders
+	mcl::Shader particle_shader;	
+
+    // Define the names of the shader files
+    std::stringstream vshader, fshader;
+    vshader << SRC_DIR << "/vshader_particle.glsl";
+    fshader << SRC_DIR << "/fshader_particle.glsl";
+    
+    // Load the shaders and use the resulting shader program
+    particle_shader.init_from_files( vshader.str(), fshader.str() );
+	particle_shader.enable();
+	currentShader = particle_shader;
+
+	// Stream particles through a persistently mapped ring where the context
+	// allows it, and through an orphaned buffer otherwise (e.g. plain GL 3.2)
+	persistentUpload = options.upload != UPLOAD_ORPHAN && bufferStorageSupported();
+	if (options.upload == UPLOAD_PERSISTENT && !persistentUpload)
+		cout << "Persistent buffer mapping isn't supported; orphaning buffers instead" << endl;
+	cout << "Streaming particles through " << (persistentUpload ? "a persistently mapped ring" : "an orphaned buffer") << endl;
+
+	// Initalize particles and scene geometry
+	init(particle_shader);
+	glClearColor( scene->view.clearColor[0], scene->view.clearColor[1], scene->view.clearColor[2], scene->view.clearColor[3] );
+
+
+	// ------------ Scene setup ------------------
+
+	// Initialize scene variables
+	Globals::eye = scene->view.eye;
+	Globals::view_dir = Vec3f(0.0, 0.0, 1.0);
+	Globals::up_dir = Vec3f(0.0, 1.0, 0.0);
+	Globals::right_dir = Vec3f(1.0, 0.0, 0.0);
+	generateViewing();
+	generateProjection(-.1, -.1, .1, .1, 0.1, scene->view.farPlane);
+
+	glUniform3f( particle_shader.uniform("lightAmbient"), lightAmb[0], lightAmb[1], lightAmb[2] );
+	glUniform3f( particle_shader.uniform("lightColor"), lightCol[0], lightCol[1], lightCol[2] );
+	glUniform3f( particle_shader.uniform("lightDirection"), lightDir[0], lightDir[1], lightDir[2] );
+	glUniform1f( particle_shader.uniform("maxSize"), MAXSIZE );
+
+	uint64_t CUR, PREV;
+	CUR = glfwGetTimerValue();
+	double timePassed = 0;
+	double timeUnasked = 0;		// seconds passed since the simulation was last asked for a frame
+	bool frameAsked = false;	// the simulation is packing a frame not taken yet
+
+	uint frames = 0;
+	long long frame = 0;		// frames drawn so far
+	double counter = 0;
+	long long uploaded = 0;	// bytes of particle vertices uploaded since the last display
+	size_t firstTimed = 0;		// first frame timed since the last display
+	size_t numHitches = 0;		// hitches reported so far
+
+	Profiler frameProfiler(options.hitchMs);
+	profiler = &frameProfiler;
+	profiler->setTracing(!options.tracePath.empty());
+	if (options.counters && !profiler->setCounting(true))
+		cout << "hardware counters aren't available" << endl;
+	profiler->nameThread("render");
+	system.setProfiler(profiler);
+
+	double movementSpeed = 0.1;
+
+	// Bind the vertex array buffer
+	glBindVertexArray( vao );
+
+	// ------------ Simulation setup -------------
+
+	scene->init(system);
+	system.setInterpolated(true);
+
+	// The first snapshot is packed here, before there are buffers to pack it
+	// into, and the simulation thread takes over the system and the scene
+	// from then on
+	packSnapshot(system, snapshots.back(), 0.0f, noRegion());
+	snapshots.publish();
+	std::thread simulation(simulate, &system, scene, threadRandom());
+
+	glUniform1f( particle_shader.uniform("specTerm"), scene->view.specTerm );
+
+	// ------------ Graphics loop ----------------
+
+	while (!glfwWindowShouldClose(window)) {
+		ProfileTimer frameTimer(profiler, PHASE_FRAME, frame);
+
+		// ------------ Physics update ---------------
+
+		PREV = CUR;
+		CUR = glfwGetTimerValue();
+		timePassed = (double) (CUR - PREV)/glfwGetTimerFrequency();
+		if (!paused)
+			timeUnasked += timePassed*timeMultiplier;
+
+		// Hand the latest snapshot to the GPU, if the simulation has packed
+		// one since the last frame, and have it start on the next
+		if (snapshots.acquire()) {
+			ProfileTimer timer(profiler, PHASE_UPLOAD, frame, snapshots.front().numParticles);
+			streamParticles(snapshots.front(), particle_shader);
+			uploaded += uploadedBytes;
+			frameAsked = false;
+		}
+		if (!frameAsked && !paused) {
+			requestFrame(timeUnasked);
+			timeUnasked = 0;
+			frameAsked = true;
+		}
+		const Snapshot &snapshot = snapshots.front();
+
+		// ------------ Input processing ---------------
+
+		if (addTimeMultiplier)
+			timeMultiplier += .01;
+		if (subTimeMultiplier)
+			timeMultiplier = max(0.01, timeMultiplier - .01);
+
+		if (Globals::key_rcontrol || Globals::key_lshift)
+			movementSpeed += .01;
+		else
+			movementSpeed = .1;
+
+		if (Globals::key_up || Globals::key_w) // Move the camera forward
+			Globals::eye += Globals::view_dir*movementSpeed;
+		if (Globals::key_down || Globals::key_s) // Move the camera backward
+			Globals::eye += Globals::view_dir*(-movementSpeed);
+		if (Globals::key_left || Globals::key_a) // Move the camera leftward
+			Globals::eye += Globals::right_dir*movementSpeed;
+		if (Globals::key_right || Globals::key_d) // Move the camera rightward
+			Globals::eye += Globals::right_dir*(-movementSpeed);
+		if (Globals::key_rshift || Globals::key_e) // Move the camera upward
+			Globals::eye += Globals::up_dir*movementSpeed; 
+		if (Globals::key_0 || Globals::key_q) // Move the camera downward
+			Globals::eye += Globals::up_dir*(-movementSpeed);
+
+		// Camera rotation is handled entirely in the mouse movement callback function
+
+		// Generate the view transformation matrix
+		generateViewing();
+		
+		// Update the uniform values on the shaders
+	glUniformMatrix4fv( particle_shader.uniform("M"), 1, GL_FALSE, Globals::model.m ); // model transformation
+	glUniformMatrix4fv( particle_shader.uniform("V"), 1, GL_FALSE, Globals::view.m ); // viewing transformation
+	glUniformMatrix4fv( particle_shader.uniform("P"), 1, GL_FALSE, Globals::projection.m ); // projection matrix
+	glUniform3f( particle_shader.uniform("eye"), Globals::eye[0], Globals::eye[1], Globals::eye[2] );
+	glUniform3f( particle_shader.uniform("viewDirection"), Globals::view_dir[0], Globals::view_dir[1], Globals::view_dir[2] );
+	glUniform1f( particle_shader.uniform("time"), (float)snapshot.time );
+
+
+		// ------------ Frame rate display ---------
+
+		frames++;
+		counter += timePassed;
+		profiler->collect();
+		for (; numHitches < profiler->hitches().size(); numHitches++) {
+			const Hitch &hitch = profiler->hitches()[numHitches];
+			cout << "Hitch: frame " << hitch.frame << " took " << hitch.milliseconds << " ms" << endl;
+		}
+		if ( counter >= 1.0 ) {
+			cout << "FPS: " << frames << " (frame p50 " << profiler->percentile(PHASE_FRAME, 50, firstTimed)
+				 << " ms, p95 " << profiler->percentile(PHASE_FRAME, 95, firstTimed)
+				 << " ms, p99 " << profiler->percentile(PHASE_FRAME, 99, firstTimed) << " ms)" << endl;
+			cout << "--- # of Particles: " << snapshot.numParticles << endl;
+			cout << "--- Bytes uploaded/frame: " << uploaded/frames << endl;
+			uploaded = 0;
+			frames = 0;
+			counter -= 1.0;
+			firstTimed = profiler->frames(PHASE_FRAME).size();
+		}
+		
+
+		// ------------ Rendering step ------------ 
+
+		ProfileTimer drawTimer(profiler, PHASE_DRAW, frame, snapshot.numParticles);
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT ); // Fill the window with the background color
+
+		// At least 1 particle needs to be rendered before any other scene geometry in
+		// order for the shader to work properly (I don't know why)
+		glDepthMask(GL_FALSE);
+		glUniform1i( particle_shader.uniform("renderingPoints"), 1 );
+		{
+			ProfileTimer timer(detailed(profiler), PHASE_DRAWCALL, frame, 1);
+			glDrawArrays( GL_POINTS, firstParticle(snapshot), 1 );
+		}
+		glDepthMask(GL_TRUE);
+
+		// Render the ground plane
+		glUniform1f( particle_shader.uniform("specTerm"), -1.0 );
+		glUniform1i( particle_shader.uniform("renderingPoints"), 0 );
+		glBindVertexArray( vao_ground );
+		{
+			ProfileTimer timer(detailed(profiler), PHASE_DRAWCALL, frame);
+			glDrawArrays( GL_TRIANGLE_FAN, 0, 4 );
+		}
+		glBindVertexArray( vao );
+
+		// Render the opaque particles first
+		glUniform1f( particle_shader.uniform("specTerm"), scene->view.specTerm );
+		glUniform1i( particle_shader.uniform("renderingPoints"), 1 );
+		glUniform1i( particle_shader.uniform("onlyOpaque"), 1 );
+		drawParticles(snapshot, particle_shader, frame);
+
+		// Then render the translucent particles
+		glDepthMask(GL_FALSE);
+		glUniform1i( particle_shader.uniform("onlyOpaque"), 0 );
+		drawParticles(snapshot, particle_shader, frame);
+		glDepthMask(GL_TRUE);
+
+		// A later snapshot may go into this frame's ring region once the GPU is done
+		fenceRegion();
+
+		glFlush();	// Ensure that all OpenGL calls have executed before swapping buffers
+		drawTimer.stop();
+
+		{
+			ProfileTimer swapTimer(profiler, PHASE_SWAP, frame);
+			glfwSwapBuffers(window);  // Swap buffers
+		}
+        glfwPollEvents(); // Process events that have happened since last update
+		frame++;
+
+	} // End graphics loop
+
+	// Clean up
+	stopSimulation();
+	simulation.join();
+	glfwDestroyWindow(window);
+	glfwTerminate();  // Destroys any remaining objects, frees resources allocated by GLFW
+	delete scene;
+
+	system.setProfiler(NULL);
+	frameProfiler.finish();
+	frameProfiler.report(cout);
+	if (!options.profilePath.empty() && !frameProfiler.write(options.profilePath))
+		cout << "couldn't write " << options.profilePath << endl;
+	if (!options.tracePath.empty() && !frameProfiler.writeTrace(options.tracePath))
+		cout << "couldn't write " << options.tracePath << endl;
+	profiler = NULL;
+	return EXIT_SUCCESS;
+
+} // end runViewer
+
+#endif
@@ -1,14 +1,28 @@
 #version 330
 in vec4 vertex_position;
 in vec4 vertex_color;
-in float particle_lighting;
-in float particle_size;
-in float particle_blur;
+in float particle_size;				// fraction of maxSize
+in vec2 particle_blur_lighting;		// blur, then lighting
+
+// Spawn state of stateless particles, whose vertex_position and vertex_color
+// are their position and color at spawn
+in vec3 spawn_velocity;
+in vec4 spawn_color_end;
+in vec3 spawn_times;				// birth, aging rate, color speed
+
+// Forces the shader can evaluate (see particle_system.hpp)
+#define FORCE_FIREWORK 1
+#define FORCE_EXPLOSION 2
+#define GRAVITY 9.8
+#define DRAG 2.0
 
 uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
 uniform vec3 eye;
+uniform float maxSize;
+uniform int evaluatedForce;		// force of the stateless particles drawn, 0 for streamed ones
+uniform float time;				// seconds simulated
 
 out vec4 vposition;
 out vec4 vcolor;
@@ -16,13 +30,41 @@ out float plighting;
 out float pblur;
 
 void main()  {
-	gl_Position = P*M*V*vertex_position;
+	vec4 position = vertex_position;
+	vec4 color = vertex_color;
+	float size = particle_size;
+
+	// Stateless particles are closed-form functions of their spawn state and
+	// the time since they spawned
+	if (evaluatedForce != 0) {
+		float t = time - spawn_times.x;
+		color = mix(vertex_color, spawn_color_end, 1.0 - exp(-spawn_times.z*t));
+
+		// Expired particles can linger in a ring until the older ones die;
+		// transparent, they are never drawn
+		if (t*spawn_times.y > 1.0)
+			color.a = 0.0;
+
+		if (evaluatedForce == FORCE_FIREWORK) {
+			// Gravity, shrinking over the particle's life
+			position.xyz += spawn_velocity*t;
+			position.y -= GRAVITY*t*t/2.0;
+			size = (1.0 - t*spawn_times.y)/3.0;
+		}
+		else if (evaluatedForce == FORCE_EXPLOSION) {
+			// Drag slows every axis by DRAG per second until it stops
+			vec3 moving = min(vec3(t), abs(spawn_velocity)/DRAG);
+			position.xyz += spawn_velocity*moving - sign(spawn_velocity)*DRAG*moving*moving/2.0;
+		}
+	}
+
+	gl_Position = P*M*V*position;
 
-	float dist = distance(eye, vertex_position.xyz);
-	gl_PointSize = max(1.0, particle_size/dist);
+	float dist = distance(eye, position.xyz);
+	gl_PointSize = max(1.0, size*maxSize/dist);
 	
-	vposition = vertex_position;
-	vcolor = vertex_color;
-	plighting = particle_lighting;
-	pblur = particle_blur;
+	vposition = position;
+	vcolor = color;
+	pblur = particle_blur_lighting.x;
+	plighting = particle_blur_lighting.y;
 }